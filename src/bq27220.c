@@ -84,11 +84,9 @@
 #define UNSEAL_KEY2  0x3672
 
 
-#define LOGLEVEL_ERROR 1
-#define LOGLEVEL_INFO 2
-#define LOGLEVEL_DEBUG 3
-#define LOG(level, fmt, arg...)  do{if((level) <= bq27220_log_level)log_printf("--BQ27220-- " fmt "\n", ##arg);}while(0)
+#define LOG(level, fmt, arg...)  LOG_PRINT(level, bq27220_log_level, "--BQ27220-- " fmt "\n", ##arg)
 unsigned char bq27220_log_level = LOGLEVEL_INFO;
+LOG_MODULE_REGISTER("BQ27220", bq27220_log_level)
 
 
 extern I2C_HandleTypeDef hi2c1;
@@ -1,4 +1,5 @@
 #include "disk_monitor.h"
+#include "log.h"
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
@@ -14,17 +15,14 @@
 
 
 
-#define LOGLEVEL_ERROR  1
-#define LOGLEVEL_INFO   2
-#define LOGLEVEL_DEBUG  3
 #define LOG(level, fmt, arg...) \
     do { \
-        if (diskm_debug < level) \
+        if (!LOG_ENABLED(level, diskm_debug)) \
             break; \
         if (LOGLEVEL_ERROR == level) \
-            printf("\e[1;31m--DiskM-- " fmt "\e[0m\n", ##arg); \
+            log_printf("\e[1;31m--DiskM-- " fmt "\e[0m\n", ##arg); \
         else \
-            printf("--DiskM-- " fmt "\n", ##arg); \
+            log_printf("--DiskM-- " fmt "\n", ##arg); \
     } while(0)
 
 #ifndef DISKM_CB_MAX
@@ -48,6 +46,7 @@ typedef struct
 
 
 unsigned char diskm_debug = LOGLEVEL_INFO;
+LOG_MODULE_REGISTER("DiskM", diskm_debug)
 static pthread_mutex_t diskm_mutex = PTHREAD_MUTEX_INITIALIZER;
 static unsigned char diskm_inited = 0;
 static unsigned char should_run = 0;
@@ -65,14 +64,14 @@ static void print_uevent(const unsigned char *uevent, unsigned int uevent_len)
     if ((NULL == uevent) || (0 == uevent_len))
         return;
 
-    printf("\n--------------------------------\n");
-    printf("%s\n", uevent);
+    log_printf("\n--------------------------------\n");
+    log_printf("%s\n", uevent);
 
     while (uevent < end)
     {
         if (*uevent++)
             continue;
-        printf("%s\n", uevent);
+        log_printf("%s\n", uevent);
     }
 }
 
@@ -332,7 +331,7 @@ static void* monitor(void *arg)
             continue;
 
         uevent_buf[uevent_len - 1] = 0;
-        if (LOGLEVEL_DEBUG <= diskm_debug)
+        if (LOG_ENABLED(LOGLEVEL_DEBUG, diskm_debug))
             print_uevent(uevent_buf, uevent_len);
 
         if (NULL == uevent_search(uevent_buf, uevent_len, "SUBSYSTEM=block"))
@@ -19,20 +19,30 @@
  * aa a5 a5 a5  <->  aa a5 a5 a5 a5 a5 a5
  *              ...
  *
+ * COBS (EMSG_PROTOCOL_COBS)
+ * ============================================
+ * | COBS(SRC DST MSG_ID LEN PAYLOAD CRC) | 00 |
+ * ============================================
+ * no SOF, crc is the same as above (including aa 55)
+ * each block: | code | code-1 bytes without 00 |, a 00 follows the block if code < ff
+ * overhead: 1 byte per 254 bytes + 00 delimiter
+ *
  */
 
 #include "emsg.h"
 #include "crc.h"
 #include "log.h"
+#include "trace.h"
+#include "record_ring.h"
 #include "emsg_config.h"
+#include <string.h>
 
 
 
 
-#define LOGLEVEL_ERROR  1
-#define LOGLEVEL_INFO   2
-#define LOGLEVEL_DEBUG  3
-#define LOG(level, fmt, arg...)  do{if((level) <= emsg_log_level)log_printf("--EMSG-- " fmt, ##arg);}while(0)
+#define LOG(level, fmt, arg...)          LOG_PRINT(level, emsg_log_level, "--EMSG-- " fmt, ##arg)
+#define LOG_LIMITED(level, fmt, arg...)  LOG_PRINT_LIMITED(level, emsg_log_level, 10, 10, "--EMSG-- " fmt, ##arg)
+#define LOG_HEX(level, prefix, data, len)  LOG_HEXDUMP(level, emsg_log_level, "--EMSG-- " prefix, data, len)
 
 #define EMSG_SOF_1        0xaa
 #define EMSG_SOF_2        0x55
@@ -41,43 +51,123 @@
 #ifndef EMSG_CB_MAX
 #define EMSG_CB_MAX  64
 #endif
+#if EMSG_CB_MAX >= 0xff
+#error "EMSG_CB_MAX must be less than 255"
+#endif
+#define EMSG_CB_HASH_SIZE  32    /* 按 msg_id 分桶, 必须是2的幂 */
+#define EMSG_CB_NONE       0xff  /* 链表结束 */
+#define CB_HASH(msg_id)    ((msg_id) & (EMSG_CB_HASH_SIZE - 1))
+
+#define EMSG_ROUTE_METRIC_DIRECT  0  /* dst_addr 就是连接的对端 */
+#define EMSG_ROUTE_METRIC_CONFIG  1  /* 配置的 routing_table */
+
+#ifndef EMSG_TX_BUF_SIZE
+#define EMSG_TX_BUF_SIZE  64  /* 每次发送在栈上的编码缓冲区, 满了就交给 sender */
+#endif
+#define EMSG_TX_IOV_MAX   16
+
+#define EMSG_BULK_MIN  4  /* 快速路径的最小长度, 太短不值得调用 memchr */
+
+/*
+ * 转义解码的状态转移表, 按 [escape_state][字节类别] 索引, 和 escape_send 对应:
+ *   发送端在 aa 55 之间插入 a5, 在 aa 后的每个 a5 前再插入 a5
+ * 表项: bit0~2 下一个状态, bit3 删掉前一个字节(转义符),
+ *       bit4~5 重新同步: 0 不需要, 否则 decoded_len 置为 n-1, 计一次错误, 丢弃当前字节
+ */
+#define CLS_OTHER  0
+#define CLS_SOF_1  1
+#define CLS_SOF_2  2
+#define CLS_ESC    3
+
+#define DFA_DEC          0x08
+#define DFA_RESYNC(len)  (((len) + 1) << 4)
+#define DFA_RESYNC_MASK  0x30
+
+static const uint8_t emsg_byte_class[256] =
+{
+    [EMSG_SOF_1] = CLS_SOF_1,
+    [EMSG_SOF_2] = CLS_SOF_2,
+    [EMSG_ESCAPE_CHAR] = CLS_ESC,
+};
+
+static const uint8_t emsg_escape_dfa[5][4] =
+{
+    /*                  OTHER              SOF_1              SOF_2              ESC          */
+    /* 0           */ { 0,                 1,                 0,                 0           },
+    /* 1:aa        */ { 0,                 1,                 0 | DFA_RESYNC(2), 2           },
+    /* 2:aaa5      */ { 2 | DFA_RESYNC(0), 2 | DFA_RESYNC(1), 0 | DFA_DEC,       3 | DFA_DEC },
+    /* 3:aa[a5a5]  */ { 0,                 1,                 0,                 4           },
+    /* 4:aa[a5a5]a5*/ { 4 | DFA_RESYNC(0), 4 | DFA_RESYNC(1), 4 | DFA_RESYNC(0), 3 | DFA_DEC },
+};
 
 
 typedef struct
 {
     uint32_t decoded_len;
     uint8_t escape_state;
-    uint8_t pad;
+    uint8_t cobs_zero;
     uint16_t errors;
 }decoder_state_t;
 typedef struct
 {
     uint8_t dst_addr;
-    uint8_t pad[2];
+    uint8_t protocol;
+    uint8_t pad;
     uint8_t route_count;
     uint8_t *routing_table;
     uint8_t decode_buf[EMSG_MSG_LEN_MAX];
     emsg_sender_t sender;
+    emsg_sendv_t sendv;
     decoder_state_t decoder_state;
+
+    /* 发送队列, 每个优先级一个, 由 sender 启动DMA, emsg_tx_done 中发送下一帧 */
+    uint8_t txq;
+    uint8_t tx_busy;
+    uint8_t tx_prio;    /* 正在发送的帧的优先级 */
+    uint8_t tx_lock[EMSG_PRIO_COUNT];  /* 从预留到提交之间置位, 队列只能有一个上下文在放入 */
+    uint16_t tx_count[EMSG_PRIO_COUNT];
+    record_ring_t tx_ring[EMSG_PRIO_COUNT];
 }emsg_conn_t;
 
+/* 一次发送的编码状态, 在调用者的栈上, 不同上下文可以同时向同一个连接发送 */
+typedef struct
+{
+    emsg_conn_t *conn;
+    uint8_t *ptr;       /* 编码的目标, buf 或发送队列中预留的记录 */
+    uint32_t size;
+    uint32_t len;
+    uint32_t iovcnt;
+    emsg_iovec_t iov[EMSG_TX_IOV_MAX];
+    uint8_t buf[EMSG_TX_BUF_SIZE];
+}emsg_tx_t;
+
 typedef struct
 {
     emsg_cb_t cb;  /* 同时用来标记是否已用 */
     uint16_t msg_id;
     uint8_t local_only;
-    uint8_t pad;
+    uint8_t next;  /* 同一个桶中的下一个 */
 }emsg_cb_info_t;
 
+typedef struct
+{
+    uint8_t conn_id;  /* EMSG_CONN_NONE 表示没有路由 */
+    uint8_t metric;   /* 越小越优先 */
+}emsg_route_t;
+
 uint8_t emsg_log_level = LOGLEVEL_ERROR;
+LOG_MODULE_REGISTER("EMSG", emsg_log_level)
 
 static emsg_conn_t emsg_conn_list[EMSG_CONN_CFG_COUNT] = {0};
 static emsg_cb_info_t emsg_cb_list[EMSG_CB_MAX] = {0};
+static uint8_t emsg_cb_hash[EMSG_CB_HASH_SIZE] = {[0 ... EMSG_CB_HASH_SIZE - 1] = EMSG_CB_NONE};
+static emsg_route_t emsg_route_list[256];
 
 
 int emsg_init(void)
 {
-    int i;
+    uint32_t size;
+    int i, j;
 
     for (i = 0; i < EMSG_CONN_CFG_COUNT; i++)
     {
@@ -100,14 +190,97 @@ int emsg_init(void)
             emsg_conn_list[i].routing_table = emsg_conn_cfg_list[i].routing_table;
         }
         emsg_conn_list[i].sender = emsg_conn_cfg_list[i].sender;
+        emsg_conn_list[i].sendv = emsg_conn_cfg_list[i].sendv;
+
+        /* 队列平分给两个优先级, 每一半为空时要保证能预留一条最长的帧 */
+        size = (emsg_conn_cfg_list[i].tx_queue_size / 2) & (~3U);
+        emsg_conn_list[i].txq = 0;
+        if (emsg_conn_cfg_list[i].tx_queue && emsg_conn_cfg_list[i].tx_queue_size)
+        {
+            if ((NULL == emsg_conn_list[i].sender) || (EMSG_TX_QUEUE_MIN / 2 > size))
+            {
+                LOG(LOGLEVEL_ERROR, "conn(%u) tx queue size(%u) is too small or sender is NULL !",
+                    i, emsg_conn_cfg_list[i].tx_queue_size);
+                return -1;
+            }
+            rring_init(&emsg_conn_list[i].tx_ring[EMSG_PRIO_CONTROL], emsg_conn_cfg_list[i].tx_queue, size);
+            rring_init(&emsg_conn_list[i].tx_ring[EMSG_PRIO_BULK], ((uint8_t *)emsg_conn_cfg_list[i].tx_queue) + size, size);
+            emsg_conn_list[i].tx_count[EMSG_PRIO_CONTROL] = 0;
+            emsg_conn_list[i].tx_count[EMSG_PRIO_BULK] = 0;
+            emsg_conn_list[i].tx_busy = 0;
+            emsg_conn_list[i].tx_lock[EMSG_PRIO_CONTROL] = 0;
+            emsg_conn_list[i].tx_lock[EMSG_PRIO_BULK] = 0;
+            emsg_conn_list[i].txq = 1;
+        }
+
+        emsg_conn_list[i].protocol = emsg_conn_cfg_list[i].protocol;
+        if (EMSG_PROTOCOL_COBS == emsg_conn_list[i].protocol)
+        {
+            emsg_conn_list[i].decoder_state.decoded_len = 2;  /* 上电后的第一帧前面可能没有分隔符 */
+        }
+        else if (EMSG_PROTOCOL_ESCAPE != emsg_conn_list[i].protocol)
+        {
+            LOG(LOGLEVEL_ERROR, "conn(%u) protocol(%u) is not supported !", i, emsg_conn_list[i].protocol);
+            return -1;
+        }
         *emsg_conn_cfg_list[i].conn_id = i;
     }
 
+    /* 直连的优先, 同样的 metric 先配置的优先 */
+    for (i = 0; i < 256; i++)
+    {
+        emsg_route_list[i].conn_id = EMSG_CONN_NONE;
+        emsg_route_list[i].metric = 0xff;
+    }
+    for (i = 0; i < EMSG_CONN_CFG_COUNT; i++)
+    {
+        if (EMSG_CONN_NONE == emsg_route_list[emsg_conn_list[i].dst_addr].conn_id)
+            emsg_route_update(emsg_conn_list[i].dst_addr, i, EMSG_ROUTE_METRIC_DIRECT);
+    }
+    for (i = 0; i < EMSG_CONN_CFG_COUNT; i++)
+    {
+        for (j = 0; j < emsg_conn_list[i].route_count; j++)
+        {
+            if (EMSG_CONN_NONE == emsg_route_list[emsg_conn_list[i].routing_table[j]].conn_id)
+                emsg_route_update(emsg_conn_list[i].routing_table[j], i, EMSG_ROUTE_METRIC_CONFIG);
+        }
+    }
+
     return 0;
 }
 
+int emsg_route_update(uint8_t dst_addr, uint8_t conn_id, uint8_t metric)
+{
+    emsg_route_t *route = &emsg_route_list[dst_addr];
+
+    if ((EMSG_CONN_CFG_COUNT <= conn_id) || (EMSG_DEVICE_ADDR_LOCAL == dst_addr))
+        return -1;
+    /* 经过其他连接的路由更优时不替换 */
+    if ((EMSG_CONN_NONE != route->conn_id) && (conn_id != route->conn_id) && (route->metric < metric))
+        return -1;
+
+    route->metric = metric;
+    route->conn_id = conn_id;
+    return 0;
+}
+
+int emsg_route_delete(uint8_t dst_addr)
+{
+    emsg_route_list[dst_addr].conn_id = EMSG_CONN_NONE;
+    emsg_route_list[dst_addr].metric = 0xff;
+    return 0;
+}
+
+int emsg_route_get(uint8_t dst_addr)
+{
+    uint8_t conn_id = emsg_route_list[dst_addr].conn_id;
+
+    return (EMSG_CONN_NONE == conn_id) ? -1 : conn_id;
+}
+
 int emsg_register_cb(uint16_t msg_id, emsg_cb_t cb, uint8_t local_only)
 {
+    uint8_t *pnext;
     int i;
 
     if (NULL == cb)
@@ -115,29 +288,60 @@ int emsg_register_cb(uint16_t msg_id, emsg_cb_t cb, uint8_t local_only)
 
     for (i = 0; i < EMSG_CB_MAX; i++)
     {
-        if (emsg_cb_list[i].cb)
-            continue;
-        emsg_cb_list[i].msg_id = msg_id;
-        emsg_cb_list[i].local_only = local_only;
-        emsg_cb_list[i].cb = cb;
-        return 0;
+        if (NULL == emsg_cb_list[i].cb)
+            break;
     }
+    if (EMSG_CB_MAX <= i)
+    {
+        LOG(LOGLEVEL_ERROR, "register cb failed, count exceeds the max(%u) !\n", EMSG_CB_MAX);
+        return -1;
+    }
+
+    emsg_cb_list[i].msg_id = msg_id;
+    emsg_cb_list[i].local_only = local_only;
+    emsg_cb_list[i].next = EMSG_CB_NONE;
+    emsg_cb_list[i].cb = cb;
+
+    /* 加到桶的末尾, 保持注册的顺序 */
+    pnext = &emsg_cb_hash[CB_HASH(msg_id)];
+    while (EMSG_CB_NONE != *pnext)
+        pnext = &emsg_cb_list[*pnext].next;
+    *pnext = i;
+    return 0;
+}
 
-    LOG(LOGLEVEL_ERROR, "register cb failed, count exceeds the max(%u) !\n", EMSG_CB_MAX);
+int emsg_unregister_cb(uint16_t msg_id, emsg_cb_t cb)
+{
+    uint8_t *pnext;
+    uint8_t i;
+
+    pnext = &emsg_cb_hash[CB_HASH(msg_id)];
+    while (EMSG_CB_NONE != *pnext)
+    {
+        i = *pnext;
+        if ((msg_id == emsg_cb_list[i].msg_id) && (cb == emsg_cb_list[i].cb))
+        {
+            /* 不改 next, 回调中注销自己时遍历可以继续 */
+            *pnext = emsg_cb_list[i].next;
+            emsg_cb_list[i].cb = NULL;
+            return 0;
+        }
+        pnext = &emsg_cb_list[i].next;
+    }
     return -1;
 }
 
 static void do_msg_cb(uint8_t src_addr, uint16_t msg_id, const void *data, uint16_t len)
 {
-    int i;
+    uint8_t i;
+    uint8_t next;
 
     if (0 == len)
         data = NULL;
 
-    for (i = 0; i < EMSG_CB_MAX; i++)
+    for (i = emsg_cb_hash[CB_HASH(msg_id)]; EMSG_CB_NONE != i; i = next)
     {
-        if (NULL == emsg_cb_list[i].cb)
-            return;
+        next = emsg_cb_list[i].next;
         if (msg_id != emsg_cb_list[i].msg_id)
             continue;
         if (emsg_cb_list[i].local_only && (EMSG_DEVICE_ADDR_LOCAL != src_addr))
@@ -146,43 +350,108 @@ static void do_msg_cb(uint8_t src_addr, uint16_t msg_id, const void *data, uint1
     }
 }
 
-int emsg_recv(uint8_t conn_id, const void *data, size_t len)
+static int emsg_forward(uint8_t conn_id, emsg_header_t *header, uint32_t msg_len);
+
+/* 处理一条完整的消息, 出错返回-1 */
+static int emsg_msg_process(uint8_t conn_id, emsg_header_t *header, uint32_t msg_len)
 {
-    uint32_t decoded_len;
-    uint8_t escape_state;  /* 1:aa 2:aaa5 3:aa[a5a5] 4:aa[a5a5]a5 */
-    uint16_t errors;
-    emsg_header_t *header;
-    uint16_t payload_len;
-    uint32_t msg_len = 0;
+    uint16_t payload_len = msg_len - sizeof(emsg_header_t) - 4;
     uint16_t msg_id;
-    uint8_t _data;
     uint8_t *pcrc;
     uint32_t crc;
-    uint32_t i;
 
 
-    if (EMSG_CONN_CFG_COUNT <= conn_id)
+    header->sof[0] = EMSG_SOF_1;
+    header->sof[1] = EMSG_SOF_2;
+    pcrc = ((uint8_t *)header) + msg_len - 4;
+
+    if (LOG_ENABLED(LOGLEVEL_DEBUG, emsg_log_level))
+    {
+        LOG_HEX(LOGLEVEL_DEBUG, "    header: ", header, sizeof(emsg_header_t));
+        LOG_HEX(LOGLEVEL_DEBUG, "    data  : ", header->payload, payload_len);
+
+        LOG(LOGLEVEL_DEBUG, "    crc   : %02x %02x %02x %02x\n", pcrc[0], pcrc[1], pcrc[2], pcrc[3]);
+    }
+
+    crc = crc32_cksum(NULL, header, msg_len - 4);
+    if (   (pcrc[0] != (crc >> 24))
+        || (pcrc[1] != ((crc >> 16) & 0xff))
+        || (pcrc[2] != ((crc >> 8) & 0xff))
+        || (pcrc[3] != (crc & 0xff)))
+    {
+        LOG_LIMITED(LOGLEVEL_ERROR, "conn(%u) recv msg crc error !\n", conn_id);
+        emsg_conn_list[conn_id].decoder_state.errors++;
         return -1;
-    if ((NULL == data) && len)
+    }
+    if (EMSG_DEVICE_ADDR_LOCAL == header->src)
+    {
+        LOG(LOGLEVEL_ERROR, "conn(%u) recv msg failed, src_addr cannot be LOCAL_ADDR(%u) !\n", conn_id, EMSG_DEVICE_ADDR_LOCAL);
         return -1;
-    if (0 == len)
-        return 0;
+    }
 
-    if (LOGLEVEL_DEBUG <= emsg_log_level)
+    msg_id = (header->msg_id[0] << 8) | header->msg_id[1];
+    LOG(LOGLEVEL_INFO, "recv msg, src:%u dst:%u id:%u len:%u\n", header->src, local_device_addr, msg_id, payload_len);
+    if (header->dst == local_device_addr)
     {
-        LOG(LOGLEVEL_DEBUG, "conn(%d) recv msg(%zu): ", conn_id, len);
-        for (i = 0; i < len; i++)
-            log_printf("%02x ", ((uint8_t *)data)[i]);
-        log_printf("\n");
+        do_msg_cb(header->src, msg_id, header->payload, payload_len);
     }
+    else
+    {
+        LOG(LOGLEVEL_INFO, "do route:\n");
+        emsg_forward(conn_id, header, msg_len);
+    }
+    return 0;
+}
+
+static void emsg_recv_escape(uint8_t conn_id, const void *data, size_t len)
+{
+    uint32_t decoded_len;
+    uint8_t escape_state;  /* 1:aa 2:aaa5 3:aa[a5a5] 4:aa[a5a5]a5 */
+    emsg_header_t *header;
+    uint16_t payload_len;
+    uint32_t msg_len = 0;
+    uint8_t _data;
+    const uint8_t *p;
+    size_t n;
+    uint8_t action;
+
 
     decoded_len  = emsg_conn_list[conn_id].decoder_state.decoded_len;
     escape_state = emsg_conn_list[conn_id].decoder_state.escape_state;
-    errors       = emsg_conn_list[conn_id].decoder_state.errors;
     header       = (emsg_header_t *)emsg_conn_list[conn_id].decode_buf;
 
     while (len--)
     {
+        /*
+         * 快速路径: 只有 0xaa 后面才会有转义, 普通数据用 memchr 找到下一个 0xaa 后整块复制
+         * 最多复制到长度判断(头部收完或整条消息收完)的前一个字节, 剩下的交给状态机
+         */
+        if (0 == decoded_len)
+        {
+            p = (const uint8_t *)memchr(data, EMSG_SOF_1, len + 1);
+            if (NULL == p)
+                break;
+            len -= p - (const uint8_t *)data;
+            data = p;
+        }
+        else if ((0 == escape_state) && (2 <= decoded_len))
+        {
+            n = msg_len ? msg_len : sizeof(emsg_header_t);
+            n = (decoded_len + 1 < n) ? (n - decoded_len - 1) : 0;
+            if (len < n)
+                n = len;
+            if (EMSG_BULK_MIN <= n)
+            {
+                p = (const uint8_t *)memchr(data, EMSG_SOF_1, n);
+                if (p)
+                    n = p - (const uint8_t *)data;
+                memcpy(((uint8_t *)header) + decoded_len, data, n);
+                decoded_len += n;
+                data = ((const uint8_t *)data) + n;
+                len -= n;
+            }
+        }
+
         _data = *((uint8_t *)data);
         data = ((uint8_t *)data) + 1;
 
@@ -213,202 +482,349 @@ int emsg_recv(uint8_t conn_id, const void *data, size_t len)
             continue;
         }
 
-        if (0 == escape_state)
+        action = emsg_escape_dfa[escape_state][emsg_byte_class[_data]];
+        escape_state = action & 0x07;
+        if (action & DFA_RESYNC_MASK)
         {
-            if (EMSG_SOF_1 == _data)
-                escape_state = 1;
+            decoded_len = ((action & DFA_RESYNC_MASK) >> 4) - 1;
+            msg_len = 0;
+            emsg_conn_list[conn_id].decoder_state.errors++;
+            continue;
         }
-        else if (1 == escape_state)
+        if (action & DFA_DEC)
+            decoded_len--;
+
+        ((uint8_t *)header)[decoded_len++] = _data;
+        if (0 == msg_len)
         {
-            if (EMSG_ESCAPE_CHAR == _data)
-            {
-                escape_state = 2;
-            }
-            else if (EMSG_SOF_1 == _data)
-            {
-                ;
-            }
-            else if (EMSG_SOF_2 == _data)
-            {
-                decoded_len = 2;
-                escape_state = 0;
-                msg_len = 0;
-                emsg_conn_list[conn_id].decoder_state.errors++;
-                continue;
-            }
-            else
+            if (   ((sizeof(emsg_header_t) <= decoded_len) && (2 != escape_state) && (4 != escape_state))
+                || (sizeof(emsg_header_t) < decoded_len))
             {
-                escape_state = 0;
+                payload_len = (header->len[0] << 8) | header->len[1];
+                if (EMSG_PAYLOAD_LEN_MAX < payload_len)
+                {
+                    LOG_LIMITED(LOGLEVEL_ERROR, "payload len(%u) exceeds the max(%u), ignore this msg !", payload_len, EMSG_PAYLOAD_LEN_MAX);
+                    decoded_len = (((uint8_t *)header)[decoded_len - 1] == EMSG_SOF_1)? 1: 0;
+                    emsg_conn_list[conn_id].decoder_state.errors++;
+                    continue;
+                }
+                msg_len = sizeof(emsg_header_t) + payload_len + 4;
             }
         }
-        else if (2 == escape_state)
+        if ((0 == msg_len) || (msg_len > decoded_len) || (2 == escape_state) || (4 == escape_state))
+            continue;
+
+        if (emsg_msg_process(conn_id, header, msg_len))
         {
-            if (EMSG_ESCAPE_CHAR == _data)
-            {
-                escape_state = 3;
-                decoded_len--;
-            }
-            else if (EMSG_SOF_2 == _data)
-            {
-                escape_state = 0;
-                decoded_len--;
-            }
-            else if (EMSG_SOF_1 == _data)
-            {
-                decoded_len = 1;
-                emsg_conn_list[conn_id].decoder_state.errors++;
-                continue;
-            }
-            else
-            {
-                decoded_len = 0;
-                emsg_conn_list[conn_id].decoder_state.errors++;
-                continue;
-            }
+            decoded_len = (((uint8_t *)header)[decoded_len - 1] == EMSG_SOF_1)? 1: 0;
+            continue;
         }
-        else if (3 == escape_state)
+        decoded_len = 0;
+    }
+
+    emsg_conn_list[conn_id].decoder_state.decoded_len = decoded_len;
+    emsg_conn_list[conn_id].decoder_state.escape_state = escape_state;
+}
+
+/*
+ * COBS 解码, 消息从 decode_buf 的 src 开始存放, 前2字节留给 sof
+ * escape_state 为当前块剩余的数据字节数, cobs_zero 表示块结束时要补一个 0x00
+ * decoded_len 为0时丢弃数据直到下一个分隔符
+ */
+static void emsg_recv_cobs(uint8_t conn_id, const void *data, size_t len)
+{
+    uint32_t decoded_len;
+    uint8_t remain;
+    uint8_t zero;
+    emsg_header_t *header;
+    uint16_t payload_len;
+    const uint8_t *src = (const uint8_t *)data;
+    const uint8_t *p;
+    size_t n;
+    uint8_t code;
+
+
+    decoded_len = emsg_conn_list[conn_id].decoder_state.decoded_len;
+    remain      = emsg_conn_list[conn_id].decoder_state.escape_state;
+    zero        = emsg_conn_list[conn_id].decoder_state.cobs_zero;
+    header      = (emsg_header_t *)emsg_conn_list[conn_id].decode_buf;
+
+    while (len)
+    {
+        if (0 == decoded_len)
         {
-            if (EMSG_ESCAPE_CHAR == _data)
-            {
-                escape_state = 4;
-            }
-            else if (EMSG_SOF_1 == _data)
-            {
-                escape_state = 1;
-            }
-            else
-            {
-                escape_state = 0;
-            }
+            p = (const uint8_t *)memchr(src, 0, len);
+            if (NULL == p)
+                break;
+            len -= p - src + 1;
+            src = p + 1;
+            decoded_len = 2;
+            remain = 0;
+            zero = 0;
+            continue;
         }
-        else if (4 == escape_state)
+
+        /* 块内的数据不会有 0x00, 整块复制 */
+        if (remain)
         {
-            if (EMSG_ESCAPE_CHAR == _data)
+            n = (len < remain) ? len : remain;
+            p = (const uint8_t *)memchr(src, 0, n);
+            if (p)
             {
-                escape_state = 3;
-                decoded_len--;
-            }
-            else if (EMSG_SOF_1 == _data)
-            {
-                decoded_len = 1;
+                /* 块没收完就遇到分隔符, 丢弃这一帧, 从分隔符之后重新开始 */
+                LOG_LIMITED(LOGLEVEL_ERROR, "conn(%u) recv cobs frame truncated !\n", conn_id);
                 emsg_conn_list[conn_id].decoder_state.errors++;
+                len -= p - src + 1;
+                src = p + 1;
+                decoded_len = 2;
+                remain = 0;
+                zero = 0;
                 continue;
             }
-            else
+            if (EMSG_MSG_LEN_MAX - decoded_len < n)
             {
-                decoded_len = 0;
+                LOG_LIMITED(LOGLEVEL_ERROR, "conn(%u) recv cobs frame exceeds the max(%u) !\n", conn_id, EMSG_MSG_LEN_MAX);
                 emsg_conn_list[conn_id].decoder_state.errors++;
+                decoded_len = 0;
                 continue;
             }
+            memcpy(((uint8_t *)header) + decoded_len, src, n);
+            decoded_len += n;
+            src += n;
+            len -= n;
+            remain -= n;
+            continue;
         }
 
-        ((uint8_t *)header)[decoded_len++] = _data;
-        if (0 == msg_len)
+        code = *src++;
+        len--;
+        if (0 != code)
         {
-            if (   ((sizeof(emsg_header_t) <= decoded_len) && (2 != escape_state) && (4 != escape_state))
-                || (sizeof(emsg_header_t) < decoded_len))
+            if (zero)
             {
-                payload_len = (header->len[0] << 8) | header->len[1];
-                if (EMSG_PAYLOAD_LEN_MAX < payload_len)
+                if (EMSG_MSG_LEN_MAX <= decoded_len)
                 {
-                    LOG(LOGLEVEL_ERROR, "payload len(%u) exceeds the max(%u), ignore this msg !", payload_len, EMSG_PAYLOAD_LEN_MAX);
-                    decoded_len = (((uint8_t *)header)[decoded_len - 1] == EMSG_SOF_1)? 1: 0;
+                    LOG_LIMITED(LOGLEVEL_ERROR, "conn(%u) recv cobs frame exceeds the max(%u) !\n", conn_id, EMSG_MSG_LEN_MAX);
                     emsg_conn_list[conn_id].decoder_state.errors++;
+                    decoded_len = 0;
                     continue;
                 }
-                msg_len = sizeof(emsg_header_t) + payload_len + 4;
+                ((uint8_t *)header)[decoded_len++] = 0;
             }
-        }
-        if ((0 == msg_len) || (msg_len > decoded_len) || (2 == escape_state) || (4 == escape_state))
+            remain = code - 1;
+            zero = (0xff != code);
             continue;
+        }
 
-        header->sof[0] = EMSG_SOF_1;
-        header->sof[1] = EMSG_SOF_2;
-        pcrc = ((uint8_t *)header) + msg_len - 4;
-
-        if (LOGLEVEL_DEBUG <= emsg_log_level)
+        /* 分隔符, 空帧直接忽略 */
+        if (2 < decoded_len)
         {
-            LOG(LOGLEVEL_DEBUG, "    header: ");
-            for (i = 0; i < sizeof(emsg_header_t); i++)
-                log_printf("%02x ", ((uint8_t *)header)[i]);
-            log_printf("\n");
+            payload_len = (sizeof(emsg_header_t) <= decoded_len) ? ((header->len[0] << 8) | header->len[1]) : 0;
+            if (   (sizeof(emsg_header_t) + 4 > decoded_len)
+                || (EMSG_PAYLOAD_LEN_MAX < payload_len)
+                || (sizeof(emsg_header_t) + payload_len + 4 != decoded_len))
+            {
+                LOG_LIMITED(LOGLEVEL_ERROR, "conn(%u) recv cobs frame len(%u) error !\n", conn_id, decoded_len - 2);
+                emsg_conn_list[conn_id].decoder_state.errors++;
+            }
+            else
+            {
+                emsg_msg_process(conn_id, header, decoded_len);
+            }
+        }
+        decoded_len = 2;
+        zero = 0;
+    }
 
-            LOG(LOGLEVEL_DEBUG, "    data  : ");
-            for (i = 0; i < payload_len; i++)
-                log_printf("%02x ", header->payload[i]);
-            log_printf("\n");
+    emsg_conn_list[conn_id].decoder_state.decoded_len = decoded_len;
+    emsg_conn_list[conn_id].decoder_state.escape_state = remain;
+    emsg_conn_list[conn_id].decoder_state.cobs_zero = zero;
+}
 
-            LOG(LOGLEVEL_DEBUG, "    crc   : %02x %02x %02x %02x\n", pcrc[0], pcrc[1], pcrc[2], pcrc[3]);
-        }
+int emsg_recv(uint8_t conn_id, const void *data, size_t len)
+{
+    uint16_t errors;
 
-        crc = crc32_cksum(NULL, header, msg_len - 4);
-        if (   (pcrc[0] != (crc >> 24))
-            || (pcrc[1] != ((crc >> 16) & 0xff))
-            || (pcrc[2] != ((crc >> 8) & 0xff))
-            || (pcrc[3] != (crc & 0xff)))
+
+    if (EMSG_CONN_CFG_COUNT <= conn_id)
+        return -1;
+    if ((NULL == data) && len)
+        return -1;
+    if (0 == len)
+        return 0;
+    TRACE_BEGIN("emsg_recv");
+
+    if (LOG_ENABLED(LOGLEVEL_DEBUG, emsg_log_level))
+    {
+        LOG(LOGLEVEL_DEBUG, "conn(%d) recv msg(%zu): ", conn_id, len);
+        log_hexdump(NULL, data, len);
+    }
+
+    errors = emsg_conn_list[conn_id].decoder_state.errors;
+    if (EMSG_PROTOCOL_COBS == emsg_conn_list[conn_id].protocol)
+        emsg_recv_cobs(conn_id, data, len);
+    else
+        emsg_recv_escape(conn_id, data, len);
+
+    if (errors != emsg_conn_list[conn_id].decoder_state.errors)
+        LOG_LIMITED(LOGLEVEL_ERROR, "conn(%u) decode errors: %u !\n", conn_id, emsg_conn_list[conn_id].decoder_state.errors);
+    TRACE_END("emsg_recv");
+    return 0;
+}
+
+int emsg_recv_ring(uint8_t conn_id, const uint8_t *buf, uint32_t size, uint32_t *rd, uint32_t wr)
+{
+    uint32_t _rd;
+
+    if ((NULL == buf) || (NULL == rd) || (0 == size))
+        return -1;
+
+    _rd = (size <= *rd) ? 0 : *rd;
+    /* DMA计数器刚减到0还没重新装载时 */
+    if (size <= wr)
+        wr = 0;
+    if (wr < _rd)
+    {
+        emsg_recv(conn_id, buf + _rd, size - _rd);
+        _rd = 0;
+    }
+    if (_rd < wr)
+    {
+        emsg_recv(conn_id, buf + _rd, wr - _rd);
+        _rd = wr;
+    }
+    *rd = _rd;
+    return 0;
+}
+
+static void tx_flush(emsg_tx_t *tx)
+{
+    uint32_t i;
+
+    if (LOG_ENABLED(LOGLEVEL_DEBUG, emsg_log_level))
+    {
+        if (tx->conn->sendv)
         {
-            LOG(LOGLEVEL_ERROR, "conn(%u) recv msg crc error !\n", conn_id);
-            decoded_len = (((uint8_t *)header)[decoded_len - 1] == EMSG_SOF_1)? 1: 0;
-            emsg_conn_list[conn_id].decoder_state.errors++;
-            continue;
+            for (i = 0; i < tx->iovcnt; i++)
+                LOG_HEX(LOGLEVEL_DEBUG, "    encode: ", tx->iov[i].data, tx->iov[i].len);
         }
-        if (EMSG_DEVICE_ADDR_LOCAL == header->src)
+        else
         {
-            LOG(LOGLEVEL_ERROR, "conn(%u) recv msg failed, src_addr cannot be LOCAL_ADDR(%u) !\n", conn_id, EMSG_DEVICE_ADDR_LOCAL);
-            decoded_len = (((uint8_t *)header)[decoded_len - 1] == EMSG_SOF_1)? 1: 0;
+            LOG_HEX(LOGLEVEL_DEBUG, "    encode: ", tx->buf, tx->len);
+        }
+    }
+
+    if (tx->conn->sendv)
+    {
+        if (tx->iovcnt)
+            tx->conn->sendv(tx->iov, tx->iovcnt);
+    }
+    else if (tx->len && tx->conn->sender)
+    {
+        tx->conn->sender(tx->buf, tx->len);
+    }
+    tx->iovcnt = 0;
+    tx->len = 0;
+}
+
+/* 复制到发送缓冲区, 用于帧头, 转义符等编码时生成的数据 */
+static void tx_copy(emsg_tx_t *tx, const uint8_t *data, uint32_t len)
+{
+    emsg_iovec_t *iov;
+    uint32_t n;
+
+    while (len)
+    {
+        /* 和上一段在缓冲区中相连时合并成一段 */
+        iov = tx->iovcnt ? &tx->iov[tx->iovcnt - 1] : NULL;
+        if ((NULL != iov) && (iov->data + iov->len != tx->ptr + tx->len))
+            iov = NULL;
+        if (   (tx->size == tx->len)
+            || (tx->conn->sendv && (NULL == iov) && (EMSG_TX_IOV_MAX == tx->iovcnt)))
+        {
+            tx_flush(tx);
             continue;
         }
 
-        msg_id = (header->msg_id[0] << 8) | header->msg_id[1];
-        LOG(LOGLEVEL_INFO, "recv msg, src:%u dst:%u id:%u len:%u\n", header->src, local_device_addr, msg_id, payload_len);
-        decoded_len = 0;
-        if (header->dst == local_device_addr)
+        n = tx->size - tx->len;
+        if (len < n)
+            n = len;
+        memcpy(tx->ptr + tx->len, data, n);
+        if (NULL != iov)
         {
-            do_msg_cb(header->src, msg_id, header->payload, payload_len);
+            iov->len += n;
         }
         else
         {
-            LOG(LOGLEVEL_INFO, "do route:\n");
-            emsg_send(header->dst, msg_id, header->payload, payload_len);
+            tx->iov[tx->iovcnt].data = tx->ptr + tx->len;
+            tx->iov[tx->iovcnt].len = n;
+            tx->iovcnt++;
         }
+        tx->len += n;
+        data += n;
+        len -= n;
     }
+}
 
-    emsg_conn_list[conn_id].decoder_state.decoded_len = decoded_len;
-    emsg_conn_list[conn_id].decoder_state.escape_state = escape_state;
-    if (errors != emsg_conn_list[conn_id].decoder_state.errors)
-        LOG(LOGLEVEL_ERROR, "conn(%u) decode errors: %u !\n", conn_id, emsg_conn_list[conn_id].decoder_state.errors);
-    return 0;
+/* 引用原始数据, 在 tx_flush 之前必须有效, 非分段发送或使用发送队列时复制 */
+static void tx_ref(emsg_tx_t *tx, const uint8_t *data, uint32_t len)
+{
+    if ((NULL == tx->conn->sendv) || tx->conn->txq)
+    {
+        tx_copy(tx, data, len);
+        return;
+    }
+    if (0 == len)
+        return;
+    if (EMSG_TX_IOV_MAX == tx->iovcnt)
+        tx_flush(tx);
+    tx->iov[tx->iovcnt].data = data;
+    tx->iov[tx->iovcnt].len = len;
+    tx->iovcnt++;
 }
 
-/* state 1:aa 2:aa[a5] */
-static uint32_t escape_encode(uint8_t *state, const uint8_t *src, uint32_t src_len, uint8_t *dst)
+/* state 1:aa 2:aa[a5], 不需要转义的数据整段引用, 只复制插入的转义符 */
+static void escape_send(emsg_tx_t *tx, uint8_t *state, const uint8_t *src, uint32_t src_len)
 {
+    static const uint8_t escape_char = EMSG_ESCAPE_CHAR;
     uint8_t _state = *state;
+    const uint8_t *run = src;
     uint8_t data;
-    uint8_t *_dst = dst;
+    const uint8_t *p;
+    uint32_t n;
+    uint8_t escape;
 
-    while (src_len--)
+    while (src_len)
     {
-        data = *src++;
+        /* 不在转义判断中时, 跳到下一个 0xaa */
+        if (0 == _state)
+        {
+            p = (const uint8_t *)memchr(src, EMSG_SOF_1, src_len);
+            n = p ? (uint32_t)(p - src) : src_len;
+            src += n;
+            src_len -= n;
+            if (0 == src_len)
+                break;
+        }
+
+        src_len--;
+        data = *src;
+        escape = 0;
 
         if (EMSG_SOF_1 == data)
         {
             _state = 1;
         }
-        else if (0 == _state)
-        {
-            ;
-        }
         else if (1 == _state)
         {
             if (EMSG_SOF_2 == data)
             {
-                *_dst++ = EMSG_ESCAPE_CHAR;
+                escape = 1;
                 _state = 0;
             }
             else if (EMSG_ESCAPE_CHAR == data)
             {
-                *_dst++ = EMSG_ESCAPE_CHAR;
+                escape = 1;
                 _state = 2;
             }
             else
@@ -419,29 +835,253 @@ static uint32_t escape_encode(uint8_t *state, const uint8_t *src, uint32_t src_l
         else if (2 == _state)
         {
             if (EMSG_ESCAPE_CHAR == data)
-                *_dst++ = EMSG_ESCAPE_CHAR;
+                escape = 1;
             else
                 _state = 0;
         }
-        *_dst++ = data;
+
+        if (escape)
+        {
+            tx_ref(tx, run, (uint32_t)(src - run));
+            tx_copy(tx, &escape_char, 1);
+            run = src;
+        }
+        src++;
     }
+    tx_ref(tx, run, (uint32_t)(src - run));
 
     *state = _state;
-    return (uint32_t)(_dst - dst);
 }
 
-int emsg_send(uint8_t dst_addr, uint16_t msg_id, const void *data, size_t len)
+/*
+ * COBS 编码, 先向后查找块的长度再输出长度字节, 块内的数据整段引用
+ * 一个块最多254字节数据, 数据结束时输出最后一个块和分隔符
+ */
+static void cobs_send(emsg_tx_t *tx, const emsg_iovec_t *seg, uint32_t count)
 {
-    uint8_t buf[EMSG_ENCODE_LEN_MAX];
-    emsg_header_t header;
+    static const uint8_t delimiter = 0;
+    uint32_t i = 0;
+    uint32_t offset = 0;
+    uint32_t j;
+    uint32_t pos;
+    uint32_t total;
+    uint32_t n;
+    const uint8_t *p;
+    uint8_t code;
+
+    for (;;)
+    {
+        p = NULL;
+        total = 0;
+        for (j = i, pos = offset; (j < count) && (254 > total); j++, pos = 0)
+        {
+            n = seg[j].len - pos;
+            if (254 - total < n)
+                n = 254 - total;
+            if (0 == n)
+                continue;
+            p = (const uint8_t *)memchr(seg[j].data + pos, 0, n);
+            if (p)
+            {
+                total += p - (seg[j].data + pos);
+                break;
+            }
+            total += n;
+        }
+
+        code = total + 1;
+        tx_copy(tx, &code, 1);
+        while (total)
+        {
+            n = seg[i].len - offset;
+            if (total < n)
+                n = total;
+            tx_ref(tx, seg[i].data + offset, n);
+            total -= n;
+            offset += n;
+            if (offset == seg[i].len)
+            {
+                i++;
+                offset = 0;
+            }
+        }
+
+        if (p)
+        {
+            /* 跳过 0x00 */
+            i = j;
+            offset = p - seg[j].data + 1;
+        }
+        else if (0xff != code)
+        {
+            break;
+        }
+    }
+    tx_copy(tx, &delimiter, 1);
+}
+
+/* 发送队列中的下一帧, 控制帧优先 */
+static void tx_kick(emsg_conn_t *conn)
+{
+    unsigned char *data;
+    unsigned int len;
+    uint8_t prio;
+
+    for (;;)
+    {
+        /* 正在发送时由 emsg_tx_done 接着发 */
+        if (__atomic_exchange_n(&conn->tx_busy, 1, __ATOMIC_ACQUIRE))
+            return;
+
+        for (prio = 0; prio < EMSG_PRIO_COUNT; prio++)
+        {
+            len = rring_get(&conn->tx_ring[prio], &data);
+            if (len)
+                break;
+        }
+        if (EMSG_PRIO_COUNT == prio)
+        {
+            __atomic_store_n(&conn->tx_busy, 0, __ATOMIC_RELEASE);
+            /* 清除 busy 之前可能又提交了帧, 看队列本身, 计数可能还没更新 */
+            if (   rring_empty(&conn->tx_ring[EMSG_PRIO_CONTROL])
+                && rring_empty(&conn->tx_ring[EMSG_PRIO_BULK]))
+                return;
+            continue;
+        }
+
+        conn->tx_prio = prio;
+        if (conn->sender(data, len))
+            return;
+
+        /* 启动失败, 丢弃这一帧 */
+        LOG_LIMITED(LOGLEVEL_ERROR, "tx start failed, drop %u bytes !\n", len);
+        rring_release(&conn->tx_ring[prio]);
+        __atomic_sub_fetch(&conn->tx_count[prio], 1, __ATOMIC_RELEASE);
+        __atomic_store_n(&conn->tx_busy, 0, __ATOMIC_RELEASE);
+    }
+}
+
+void emsg_tx_done(uint8_t conn_id)
+{
+    emsg_conn_t *conn;
+
+    if (EMSG_CONN_CFG_COUNT <= conn_id)
+        return;
+    conn = &emsg_conn_list[conn_id];
+    if ((0 == conn->txq) || (0 == __atomic_load_n(&conn->tx_busy, __ATOMIC_ACQUIRE)))
+        return;
+
+    rring_release(&conn->tx_ring[conn->tx_prio]);
+    __atomic_sub_fetch(&conn->tx_count[conn->tx_prio], 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&conn->tx_busy, 0, __ATOMIC_RELEASE);
+    tx_kick(conn);
+}
+
+/* 编码后的最大长度, len 为去掉 sof 的长度 */
+static uint32_t encode_len_max(uint8_t protocol, uint32_t len)
+{
+    if (EMSG_PROTOCOL_COBS == protocol)
+        return len + (len / 254) + 2;
+    return 2 + len * 2;
+}
+
+/*
+ * 按连接的协议编码并发送一帧, seg 为去掉 sof 的帧头, 负载和 crc
+ * 发送队列满, 或同一优先级的队列正在被其他上下文(如被打断的任务)放入时返回-1
+ */
+static int emsg_frame_send(emsg_conn_t *conn, const emsg_iovec_t *seg, uint32_t count, uint8_t prio)
+{
+    static const uint8_t sof[2] = {EMSG_SOF_1, EMSG_SOF_2};
+    emsg_tx_t tx;
     uint8_t escape_state = 0;
-    uint32_t _len;
+    uint32_t len;
+    uint32_t i;
+
+    tx.conn = conn;
+    tx.ptr = tx.buf;
+    tx.size = EMSG_TX_BUF_SIZE;
+    tx.len = 0;
+    tx.iovcnt = 0;
+
+    /* 按最长预留, 编码完再提交实际长度 */
+    if (conn->txq)
+    {
+        if (__atomic_exchange_n(&conn->tx_lock[prio], 1, __ATOMIC_ACQUIRE))
+        {
+            LOG_LIMITED(LOGLEVEL_ERROR, "send failed, tx queue(%u) is busy !\n", prio);
+            return -1;
+        }
+        for (i = 0, len = 0; i < count; i++)
+            len += seg[i].len;
+        len = encode_len_max(conn->protocol, len);
+        tx.ptr = rring_reserve(&conn->tx_ring[prio], len);
+        if (NULL == tx.ptr)
+        {
+            __atomic_store_n(&conn->tx_lock[prio], 0, __ATOMIC_RELEASE);
+            LOG_LIMITED(LOGLEVEL_ERROR, "send failed, tx queue(%u) is full !\n", prio);
+            return -1;
+        }
+        tx.size = len;
+    }
+
+    if (EMSG_PROTOCOL_COBS == conn->protocol)
+    {
+        cobs_send(&tx, seg, count);
+    }
+    else
+    {
+        tx_copy(&tx, sof, sizeof(sof));
+        for (i = 0; i < count; i++)
+            escape_send(&tx, &escape_state, seg[i].data, seg[i].len);
+    }
+
+    if (0 == conn->txq)
+    {
+        tx_flush(&tx);
+        return 0;
+    }
+
+    LOG_HEX(LOGLEVEL_DEBUG, "    encode: ", tx.ptr, tx.len);
+    /* 先计数再提交, 提交后可能马上被发完并在中断中减一 */
+    __atomic_add_fetch(&conn->tx_count[prio], 1, __ATOMIC_RELEASE);
+    rring_commit(&conn->tx_ring[prio], tx.len);
+    __atomic_store_n(&conn->tx_lock[prio], 0, __ATOMIC_RELEASE);
+    tx_kick(conn);
+    return 0;
+}
+
+/*
+ * 转发收到的消息, 帧头和 crc 原样发出, 不重新计算
+ * 转义编码是唯一的, 发往同样协议的连接时输出和收到的字节相同
+ */
+static int emsg_forward(uint8_t conn_id, emsg_header_t *header, uint32_t msg_len)
+{
+    emsg_iovec_t seg;
+    int out;
+
+    out = emsg_route_get(header->dst);
+    if (0 > out)
+    {
+        LOG_LIMITED(LOGLEVEL_ERROR, "conn(%u) forward failed, dst addr(%u) is not configured !\n", conn_id, header->dst);
+        return -1;
+    }
+
+    /* 优先级不随帧传递, 转发的都按批量数据处理 */
+    seg.data = ((uint8_t *)header) + 2;
+    seg.len = msg_len - 2;
+    return emsg_frame_send(&emsg_conn_list[out], &seg, 1, EMSG_PRIO_BULK);
+}
+
+int emsg_send_prio(uint8_t dst_addr, uint16_t msg_id, const void *data, size_t len, uint8_t prio)
+{
+    emsg_header_t header;
+    emsg_iovec_t seg[3];
     uint32_t crc;
     uint8_t crc_buf[4];
-    uint32_t i, j;
+    int conn_id;
 
 
-    if ((NULL == data) && len)
+    if (((NULL == data) && len) || (EMSG_PRIO_COUNT <= prio))
         return -1;
     if (EMSG_PAYLOAD_LEN_MAX < len)
     {
@@ -457,6 +1097,12 @@ int emsg_send(uint8_t dst_addr, uint16_t msg_id, const void *data, size_t len)
         return 0;
     }
     LOG(LOGLEVEL_INFO, "send msg, src:%u dst:%u id:%u len:%zu\n", local_device_addr, dst_addr, msg_id, len);
+    conn_id = emsg_route_get(dst_addr);
+    if (0 > conn_id)
+    {
+        LOG(LOGLEVEL_ERROR, "send failed, dst addr(%u) is not configured !\n", dst_addr);
+        return -1;
+    }
 
     header.sof[0] = EMSG_SOF_1;
     header.sof[1] = EMSG_SOF_2;
@@ -473,55 +1119,48 @@ int emsg_send(uint8_t dst_addr, uint16_t msg_id, const void *data, size_t len)
     crc_buf[2] = (crc >> 8) & 0xff;
     crc_buf[3] = crc & 0xff;
 
-    buf[0] = EMSG_SOF_1;
-    buf[1] = EMSG_SOF_2;
-    _len = 2;
-    _len += escape_encode(&escape_state, ((uint8_t *)&header) + 2, (uint32_t)(sizeof(emsg_header_t) - 2), buf + 2);
-    _len += escape_encode(&escape_state, data, (uint32_t)len, buf + _len);
-    _len += escape_encode(&escape_state, crc_buf, (uint32_t)sizeof(crc_buf), buf + _len);
-
-    if (LOGLEVEL_DEBUG <= emsg_log_level)
+    if (LOG_ENABLED(LOGLEVEL_DEBUG, emsg_log_level))
     {
-        LOG(LOGLEVEL_DEBUG, "    header: ");
-        for (i = 0; i < sizeof(emsg_header_t); i++)
-            log_printf("%02x ", ((uint8_t *)&header)[i]);
-        log_printf("\n");
-
-        LOG(LOGLEVEL_DEBUG, "    data  : ");
-        for (i = 0; i < len; i++)
-            log_printf("%02x ", ((uint8_t *)data)[i]);
-        log_printf("\n");
+        LOG_HEX(LOGLEVEL_DEBUG, "    header: ", &header, sizeof(emsg_header_t));
+        LOG_HEX(LOGLEVEL_DEBUG, "    data  : ", data, len);
 
         LOG(LOGLEVEL_DEBUG, "    crc   : %02x %02x %02x %02x\n", crc_buf[0], crc_buf[1], crc_buf[2], crc_buf[3]);
-
-        LOG(LOGLEVEL_DEBUG, "    encode: ");
-        for (i = 0; i < _len; i++)
-            log_printf("%02x ", buf[i]);
-        log_printf("\n");
     }
 
-    for (i = 0; i < EMSG_CONN_CFG_COUNT; i++)
-    {
-        if (dst_addr != emsg_conn_list[i].dst_addr)
-            continue;
-        if (emsg_conn_list[i].sender)
-            emsg_conn_list[i].sender(buf, _len);
-        return 0;
-    }
-    for (i = 0; i < EMSG_CONN_CFG_COUNT; i++)
-    {
-        if (0 == emsg_conn_list[i].route_count)
-            continue;
-        for (j = 0; j < emsg_conn_list[i].route_count; j++)
-        {
-            if (dst_addr != emsg_conn_list[i].routing_table[j])
-                continue;
-            if (emsg_conn_list[i].sender)
-                emsg_conn_list[i].sender(buf, _len);
-            return 0;
-        }
-    }
+    /* 帧头和 crc 在栈上, 发送完之前一直有效 */
+    seg[0].data = ((uint8_t *)&header) + 2;
+    seg[0].len = sizeof(emsg_header_t) - 2;
+    seg[1].data = (const uint8_t *)data;
+    seg[1].len = (uint32_t)len;
+    seg[2].data = crc_buf;
+    seg[2].len = sizeof(crc_buf);
 
-    LOG(LOGLEVEL_ERROR, "send failed, dst addr(%u) is not configured !\n", dst_addr);
-    return -1;
+    return emsg_frame_send(&emsg_conn_list[conn_id], seg, 3, prio);
+}
+
+int emsg_send(uint8_t dst_addr, uint16_t msg_id, const void *data, size_t len)
+{
+    return emsg_send_prio(dst_addr, msg_id, data, len, EMSG_PRIO_CONTROL);
+}
+
+int emsg_tx_depth(uint8_t dst_addr, uint8_t prio)
+{
+    int conn_id = emsg_route_get(dst_addr);
+
+    if ((0 > conn_id) || (EMSG_PRIO_COUNT <= prio) || (0 == emsg_conn_list[conn_id].txq))
+        return -1;
+    return __atomic_load_n(&emsg_conn_list[conn_id].tx_count[prio], __ATOMIC_ACQUIRE);
+}
+
+int emsg_tx_ready(uint8_t dst_addr, uint8_t prio, size_t len)
+{
+    emsg_conn_t *conn;
+    int conn_id = emsg_route_get(dst_addr);
+
+    if ((0 > conn_id) || (EMSG_PRIO_COUNT <= prio) || (EMSG_PAYLOAD_LEN_MAX < len))
+        return 0;
+    conn = &emsg_conn_list[conn_id];
+    if (0 == conn->txq)
+        return 1;
+    return rring_can_reserve(&conn->tx_ring[prio], encode_len_max(conn->protocol, sizeof(emsg_header_t) - 2 + len + 4));
 }
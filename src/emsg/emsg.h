@@ -16,13 +16,31 @@ typedef struct
 }emsg_header_t;
 
 #define EMSG_DEVICE_ADDR_LOCAL  0
+#define EMSG_CONN_NONE          0xff
 
 #define EMSG_PAYLOAD_LEN_MAX  300
 #define EMSG_MSG_LEN_MAX      (sizeof(emsg_header_t) + EMSG_PAYLOAD_LEN_MAX + 4)
 #define EMSG_ENCODE_LEN_MAX   ((((EMSG_MSG_LEN_MAX * 2) + 7) / 8) * 8)
+/* COBS 编码后的最大长度: 去掉 sof, 每254字节加1字节, 再加分隔符 */
+#define EMSG_COBS_LEN_MAX     ((EMSG_MSG_LEN_MAX - 2) + ((EMSG_MSG_LEN_MAX - 2) / 254) + 2)
 
+#define EMSG_PROTOCOL_ESCAPE  0  /* aa 55 帧头 + 转义 */
+#define EMSG_PROTOCOL_COBS    1  /* COBS 编码, 0x00 分隔 */
+
+/*
+ * 一帧可能分多次调用发送, 返回前必须发送或复制完数据
+ * 配置了发送队列时每次是完整的一帧, 只需要启动发送(返回0表示失败), 发送完成后调用 emsg_tx_done
+ */
 typedef uint32_t (*emsg_sender_t)(const uint8_t *data, uint32_t len);
 
+typedef struct
+{
+    const uint8_t *data;
+    uint32_t len;
+}emsg_iovec_t;
+/* 分段发送, 负载不需要转义的部分直接引用调用者的数据, 不经过发送缓冲区 */
+typedef uint32_t (*emsg_sendv_t)(const emsg_iovec_t *iov, uint32_t iovcnt);
+
 typedef struct
 {
     uint8_t *conn_id;
@@ -30,14 +48,49 @@ typedef struct
     uint8_t route_count;
     uint8_t *routing_table;
     emsg_sender_t sender;
+    uint8_t protocol;  /* 两端必须配置相同 */
+    emsg_sendv_t sendv;  /* 不为 NULL 时代替 sender */
+    uint32_t *tx_queue;  /* 发送队列, 为 NULL 时 emsg_send 阻塞发送 */
+    uint32_t tx_queue_size;  /* 字节, 至少为 EMSG_TX_QUEUE_MIN */
 }emsg_conn_cfg_t;
 
+#define EMSG_PRIO_CONTROL  0  /* 先发 */
+#define EMSG_PRIO_BULK     1
+#define EMSG_PRIO_COUNT    2
+/* 平分给两个优先级, 每个至少要能放下两条最长的帧 */
+#define EMSG_TX_QUEUE_MIN  (EMSG_PRIO_COUNT * 2 * (EMSG_ENCODE_LEN_MAX + 8))
+
 typedef void (*emsg_cb_t)(uint8_t src_addr, uint16_t msg_id, const void *data, uint16_t len);
 
 extern int emsg_init(void);
 extern int emsg_register_cb(uint16_t msg_id, emsg_cb_t cb, unsigned char local_only);
+/* 回调中只能注销自己 */
+extern int emsg_unregister_cb(uint16_t msg_id, emsg_cb_t cb);
 extern int emsg_recv(uint8_t conn_id, const void *data, size_t len);
+/* 环形缓冲区(如循环模式的DMA)中 [*rd, wr) 的数据直接交给 emsg_recv, 回绕时分两段, 处理后更新 *rd */
+extern int emsg_recv_ring(uint8_t conn_id, const uint8_t *buf, uint32_t size, uint32_t *rd, uint32_t wr);
+/*
+ * 按 EMSG_PRIO_CONTROL 发送, 可以在不同的任务和中断中调用
+ * 配置了发送队列时放入队列后立即返回, 队列满返回-1
+ * 同一优先级的队列在放入过程中被打断时, 打断它的上下文向这个队列发送也返回-1
+ */
 extern int emsg_send(uint8_t dst_addr, uint16_t msg_id, const void *data, size_t len);
+extern int emsg_send_prio(uint8_t dst_addr, uint16_t msg_id, const void *data, size_t len, uint8_t prio);
+/* 在发送完成中断中调用 */
+extern void emsg_tx_done(uint8_t conn_id);
+/* 队列中(包括正在发送)的帧数, 没有发送队列返回-1 */
+extern int emsg_tx_depth(uint8_t dst_addr, uint8_t prio);
+/* 能否立即放入负载长度为 len 的帧, 和 emsg_send 在同一个任务中调用 */
+extern int emsg_tx_ready(uint8_t dst_addr, uint8_t prio, size_t len);
+
+/*
+ * 路由表, emsg_init 时按配置生成, 运行时可以修改
+ * 添加或修改到 dst_addr 的路由, metric 越小越优先, 已有经过其他连接的更优路由时返回-1
+ */
+extern int emsg_route_update(uint8_t dst_addr, uint8_t conn_id, uint8_t metric);
+extern int emsg_route_delete(uint8_t dst_addr);
+/* 返回发往 dst_addr 的连接, 没有路由返回-1 */
+extern int emsg_route_get(uint8_t dst_addr);
 
 
 #endif
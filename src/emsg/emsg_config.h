@@ -10,7 +10,7 @@ static uint8_t local_device_addr = DEVICE_ADDR_A;
 
 emsg_conn_cfg_t emsg_conn_cfg_list[] =
 {
-    {&uart3_conn_id, DEVICE_ADDR_B, 0, NULL, uart3_sender}
+    {&uart3_conn_id, DEVICE_ADDR_B, 0, NULL, uart3_sender, EMSG_PROTOCOL_ESCAPE, NULL, uart3_tx_queue, UART3_TX_QUEUE_SIZE}
 };
 #define EMSG_CONN_CFG_COUNT  (sizeof(emsg_conn_cfg_list) / sizeof(emsg_conn_cfg_list[0]))
 
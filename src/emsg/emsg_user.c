@@ -1,7 +1,8 @@
 #include "emsg_user.h"
 #include "emsg.h"
 #include <stddef.h>
-#include "ring_buffer.h"
+#include "flash_log.h"
+#include "msg_define.h"
 #include "stm32l4xx_hal.h"
 #include "stm32l4xx_ll_usart.h"
 
@@ -12,59 +13,241 @@ extern UART_HandleTypeDef huart3;
 extern DMA_HandleTypeDef hdma_usart3_rx;
 
 uint8_t uart3_conn_id;
+uint32_t uart3_tx_queue[UART3_TX_QUEUE_SIZE / 4];
 
-uint8_t uart3_rx_dma_buf[EMSG_ENCODE_LEN_MAX];
-uint8_t uart3_rx_buf[EMSG_ENCODE_LEN_MAX * 4];
-ring_buffer_t uart3_rx_rbuf = RBUF_INITIALIZER(uart3_rx_buf, sizeof(uart3_rx_buf), 1);
+/* DMA循环接收, 数据直接从这里交给 emsg_recv, 两次处理之间收到的数据超过它的大小时丢弃并计入 uart3_rx_overruns */
+uint8_t uart3_rx_dma_buf[UART3_RX_BUF_SIZE];
+static uint32_t uart3_rx_rd = 0;        /* 已处理到的位置 */
+static uint32_t uart3_rx_pos = 0;       /* 已处理的总字节数, 用来判断是否被DMA套圈 */
+static uint32_t uart3_rx_halves = 0;    /* 半满和全满中断的次数, 重新启动DMA时清零 */
+static uint8_t uart3_rx_event = 0;      /* 中断中收到数据后置位 */
+static uint8_t uart3_rx_reset = 0;      /* 出错后重新启动了DMA, 从头开始 */
+static uint8_t uart3_rx_running = 0;    /* emsg_user_init 启动接收后, 出错时才重新启动 */
+uint32_t uart3_rx_overruns = 0;
 
+/* 读flash日志的请求, 接收处理完后再应答, 先写入RAM中的记录时可能要擦除flash */
+static uint8_t flog_req_pending = 0;
+static uint8_t flog_req_src;
+static flog_cursor_t flog_req_cursor;
+
+
+static void put_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = (v >> 16) & 0xff;
+    p[2] = (v >> 8) & 0xff;
+    p[3] = v & 0xff;
+}
+
+static uint32_t get_be32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void flog_read_cb(uint8_t src_addr, uint16_t msg_id, const void *data, uint16_t len)
+{
+    flog_req_cursor.seq = 0;
+    flog_req_cursor.offset = 0;
+    if (8 <= len)
+    {
+        flog_req_cursor.seq = get_be32((const uint8_t *)data);
+        flog_req_cursor.offset = get_be32((const uint8_t *)data + 4);
+    }
+    flog_req_src = src_addr;
+    flog_req_pending = 1;
+}
+
+static void flog_read_reply(void)
+{
+    uint8_t buf[EMSG_PAYLOAD_LEN_MAX];
+    flog_cursor_t cursor = flog_req_cursor;
+    flog_cursor_t next;
+    uint32_t pos = 8;
+    uint8_t type;
+    unsigned int tick;
+    int ret;
+
+    /* 先把RAM中的记录写进flash */
+    flog_flush();
+    while (pos + 6 + FLOG_DATA_MAX <= sizeof(buf))
+    {
+        next = cursor;
+        ret = flog_read(&next, &type, &tick, buf + pos + 6, FLOG_DATA_MAX);
+        if (0 > ret)
+            break;
+        cursor = next;
+        buf[pos] = ret;
+        buf[pos + 1] = type;
+        put_be32(buf + pos + 2, tick);
+        pos += 6 + ret;
+    }
+    put_be32(buf, cursor.seq);
+    put_be32(buf + 4, cursor.offset);
+
+    emsg_send_prio(flog_req_src, MSG_ID_FLOG_READ_ACK, buf, pos, EMSG_PRIO_BULK);
+}
+
+#if (USE_HAL_UART_REGISTER_CALLBACKS != 0)
+static void uart3_tx_complete_cb(UART_HandleTypeDef *huart)
+{
+    uart3_tx_complete_handler();
+}
+static void uart3_rx_half_cb(UART_HandleTypeDef *huart)
+{
+    uart3_rx_half_handler();
+}
+static void uart3_rx_complete_cb(UART_HandleTypeDef *huart)
+{
+    uart3_rx_complete_handler();
+}
+#endif
 
 int emsg_user_init(void)
 {
+#if (USE_HAL_UART_REGISTER_CALLBACKS != 0)
+    if (   (HAL_OK != HAL_UART_RegisterCallback(&huart3, HAL_UART_TX_COMPLETE_CB_ID, uart3_tx_complete_cb))
+        || (HAL_OK != HAL_UART_RegisterCallback(&huart3, HAL_UART_RX_HALFCOMPLETE_CB_ID, uart3_rx_half_cb))
+        || (HAL_OK != HAL_UART_RegisterCallback(&huart3, HAL_UART_RX_COMPLETE_CB_ID, uart3_rx_complete_cb)))
+        return -1;
+#endif
+    /* CubeMX 中 USART3_RX 的DMA必须配置为 Circular */
+    if (DMA_CIRCULAR != hdma_usart3_rx.Init.Mode)
+        return -1;
+    if (0 == flog_init())
+        emsg_register_cb(MSG_ID_FLOG_READ, flog_read_cb, 0);
     HAL_UART_ReceiverTimeout_Config(&huart3, 100);
     HAL_UART_EnableReceiverTimeout(&huart3);
     LL_USART_EnableIT_RTO(huart3.Instance);
-    HAL_UART_Receive_DMA(&huart3, uart3_rx_dma_buf, sizeof(uart3_rx_dma_buf));
+    if (HAL_OK != HAL_UART_Receive_DMA(&huart3, uart3_rx_dma_buf, sizeof(uart3_rx_dma_buf)))
+        return -1;
+    __atomic_store_n(&uart3_rx_running, 1, __ATOMIC_RELEASE);
     return 0;
 }
 
+/* 主循环中不断调用, 没有新数据时直接返回, 有数据时处理到DMA当前写入的位置 */
 void emsg_user_task(void)
 {
-    uint32_t current_ts;
-    static uint32_t uart3_ts = 0;
-    uint8_t *uart3_data;
-    uint32_t uart3_data_len;
+    const uint32_t half = sizeof(uart3_rx_dma_buf) / 2;
+    uint32_t primask;
+    uint32_t halves;
+    uint32_t wr;
+    uint32_t pos;
+    uint8_t reset;
+
+    if (0 == __atomic_exchange_n(&uart3_rx_event, 0, __ATOMIC_ACQUIRE))
+        return;
 
-    current_ts = HAL_GetTick();
+    /* 复位标志, 半满计数和DMA位置一起读, 不能夹着一次重新启动 */
+    primask = __get_PRIMASK();
+    __disable_irq();
+    reset = uart3_rx_reset;
+    uart3_rx_reset = 0;
+    halves = uart3_rx_halves;
+    wr = sizeof(uart3_rx_dma_buf) - __HAL_DMA_GET_COUNTER(&hdma_usart3_rx);
+    __set_PRIMASK(primask);
 
-    if (5 < (uint32_t)(current_ts - uart3_ts))
+    if (reset)
     {
-        uart3_ts = current_ts;
+        uart3_rx_rd = 0;
+        uart3_rx_pos = 0;
+    }
+    /* 刚越过半满或全满的位置, 中断还没处理 */
+    if ((half <= wr) != (halves & 1))
+        halves++;
+    pos = halves * half + (wr % half);
+    /* 被DMA套圈, 缓冲区中未处理的数据已经被覆盖, 丢弃 */
+    if (sizeof(uart3_rx_dma_buf) <= pos - uart3_rx_pos)
+    {
+        uart3_rx_overruns++;
+        uart3_rx_rd = wr;
+    }
+    uart3_rx_pos = pos;
+    emsg_recv_ring(uart3_conn_id, uart3_rx_dma_buf, sizeof(uart3_rx_dma_buf), &uart3_rx_rd, wr);
 
-        uart3_data_len = rbuf_get(&uart3_rx_rbuf, &uart3_data, EMSG_ENCODE_LEN_MAX);
-        if (uart3_data_len)
-            emsg_recv(uart3_conn_id, uart3_data, uart3_data_len);
+    if (flog_req_pending)
+    {
+        flog_req_pending = 0;
+        flog_read_reply();
     }
 }
 
 
+/* 只启动DMA, 发送完成中断里调用 emsg_tx_done 发送队列中的下一帧 */
 uint32_t uart3_sender(const uint8_t *data, uint32_t len)
 {
-    HAL_UART_Transmit(&huart3, data, len, len);
+    if (HAL_OK != HAL_UART_Transmit_DMA(&huart3, (uint8_t *)data, len))
+        return 0;
     return len;
 }
+void uart3_tx_complete_handler(void)
+{
+    emsg_tx_done(uart3_conn_id);
+}
+static void uart3_rx_notify(void)
+{
+    __atomic_store_n(&uart3_rx_event, 1, __ATOMIC_RELEASE);
+#ifdef EMSG_USER_RX_NOTIFY
+    EMSG_USER_RX_NOTIFY();
+#endif
+}
 void uart3_irq_handler(void)
 {
-    if (huart3.ErrorCode)
+    /* 接收超时在这里处理, HAL 会把它当作错误停止DMA */
+    if (LL_USART_IsActiveFlag_RTO(huart3.Instance))
     {
-        if (huart3.ErrorCode & HAL_UART_ERROR_RTO)
-            rbuf_put(&uart3_rx_rbuf, uart3_rx_dma_buf, sizeof(uart3_rx_dma_buf) - __HAL_DMA_GET_COUNTER(&hdma_usart3_rx);
+        LL_USART_ClearFlag_RTO(huart3.Instance);
+        uart3_rx_notify();
+    }
+
+    HAL_UART_IRQHandler(&huart3);
+
+    /* 其他错误停止了接收, 重新启动 */
+    if (__atomic_load_n(&uart3_rx_running, __ATOMIC_ACQUIRE) && (HAL_UART_STATE_READY == huart3.RxState))
+    {
+        uart3_rx_halves = 0;
+        __atomic_store_n(&uart3_rx_reset, 1, __ATOMIC_RELEASE);
         HAL_UART_Receive_DMA(&huart3, uart3_rx_dma_buf, sizeof(uart3_rx_dma_buf));
+        uart3_rx_notify();
     }
 }
+/* 连续接收时不等空闲, 每收满半个缓冲区处理一次 */
+void uart3_rx_half_handler(void)
+{
+    uart3_rx_halves++;
+    uart3_rx_notify();
+}
+void uart3_rx_complete_handler(void)
+{
+    uart3_rx_halves++;
+    uart3_rx_notify();
+}
 /*
 void USART3_IRQHandler(void)
 {
-    HAL_UART_IRQHandler(&huart3);
     uart3_irq_handler();
 }
 */
+/*
+ * 没有使用 USE_HAL_UART_REGISTER_CALLBACKS 时, HAL 的每个回调只能定义一次, 由所有串口共用
+ * log.c 开启 LOG_BUFFER_ENABLE 时已经定义了 HAL_UART_TxCpltCallback, 这时不要再定义,
+ * 在 log.h 中 #define LOG_UART_TX_CPLT_OTHER uart3_tx_cplt_callback, 否则定义下面的 HAL_UART_TxCpltCallback
+void uart3_tx_cplt_callback(UART_HandleTypeDef *huart)
+{
+    if (&huart3 == huart)
+        uart3_tx_complete_handler();
+}
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+    uart3_tx_cplt_callback(huart);
+}
+void HAL_UART_RxHalfCpltCallback(UART_HandleTypeDef *huart)
+{
+    if (&huart3 == huart)
+        uart3_rx_half_handler();
+}
+void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
+{
+    if (&huart3 == huart)
+        uart3_rx_complete_handler();
+}
+*/
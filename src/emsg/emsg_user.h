@@ -4,13 +4,29 @@
 #include <stdint.h>
 
 
+#define UART3_TX_QUEUE_SIZE  4096
+#define UART3_RX_BUF_SIZE    2048
+
+/* 中断中收到数据后调用, 用RTOS时可以用来唤醒调用 emsg_user_task 的任务 */
+/* #define EMSG_USER_RX_NOTIFY()  osThreadFlagsSet(emsg_thread_id, 0x01) */
+
 extern uint8_t uart3_conn_id;
+extern uint32_t uart3_tx_queue[UART3_TX_QUEUE_SIZE / 4];
+/* 接收处理不及时, 缓冲区被覆盖而丢弃数据的次数 */
+extern uint32_t uart3_rx_overruns;
 
 extern int emsg_user_init(void);
 extern void emsg_user_task(void);
 
 extern uint32_t uart3_sender(const uint8_t *data, uint32_t len);
 extern void uart3_irq_handler(void);
+extern void uart3_tx_complete_handler(void);
+extern void uart3_rx_half_handler(void);
+extern void uart3_rx_complete_handler(void);
+#ifdef __linux__
+/* 主机上代替 uart3 的 pty 设备名 */
+extern const char* emsg_user_pty_name(void);
+#endif
 
 
 #endif
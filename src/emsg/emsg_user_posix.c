@@ -0,0 +1,217 @@
+/*
+ * Linux 下 emsg_user.h 的实现, 替代 emsg_user.c, 用于在主机上测试
+ * 用 pty 代替 uart3, 读线程模拟循环模式的DMA写入 uart3_rx_dma_buf,
+ * emsg_user_task 和MCU上一样把新数据直接交给 emsg_recv_ring, 写线程模拟DMA发送
+ * 另一端打开 emsg_user_pty_name() 返回的设备收发
+ */
+#define _GNU_SOURCE
+#include "emsg_user.h"
+#include "emsg.h"
+#include "log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <termios.h>
+#include <pthread.h>
+#include <sys/prctl.h>
+
+
+
+
+#define UART3_WAIT_MS  10  /* emsg_user_task 没有数据时最长等待时间 */
+
+uint8_t uart3_conn_id;
+uint32_t uart3_tx_queue[UART3_TX_QUEUE_SIZE / 4];
+uint8_t uart3_rx_dma_buf[UART3_RX_BUF_SIZE];
+
+static int pty_fd = -1;
+static int pty_slave_fd = -1;  /* 一直打开, 对端关闭后读不会返回 EIO */
+static char pty_name[64] = {0};
+
+static pthread_mutex_t uart3_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t uart3_rx_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t uart3_tx_cond = PTHREAD_COND_INITIALIZER;
+static uint32_t uart3_rx_wr = 0;  /* 相当于DMA的写位置 */
+static uint32_t uart3_rx_total = 0;  /* 写入的总字节数, 和 uart3_rx_wr 一起在锁内更新 */
+static uint32_t uart3_rx_rd = 0;
+static uint32_t uart3_rx_pos = 0;  /* 已处理的总字节数 */
+static uint8_t uart3_rx_event = 0;
+static const uint8_t *uart3_tx_data = NULL;  /* 正在发送的帧 */
+static uint32_t uart3_tx_len = 0;
+
+uint32_t uart3_rx_overruns = 0;
+
+
+
+
+/* 和DMA一样只管往后写, 处理不及时会被覆盖 */
+static void* uart3_rx_thread(void *arg)
+{
+    uint32_t wr = 0;
+    ssize_t ret;
+
+
+    (void)arg;
+    prctl(PR_SET_NAME, (unsigned long)"emsg_rx", 0, 0, 0);
+
+    for (;;)
+    {
+        ret = read(pty_fd, uart3_rx_dma_buf + wr, sizeof(uart3_rx_dma_buf) - wr);
+        if (0 >= ret)
+        {
+            if ((0 > ret) && (EINTR == errno))
+                continue;
+            usleep(10000);
+            continue;
+        }
+
+        wr += ret;
+        if (sizeof(uart3_rx_dma_buf) <= wr)
+            wr = 0;
+
+        pthread_mutex_lock(&uart3_mutex);
+        uart3_rx_wr = wr;
+        uart3_rx_total += ret;
+        uart3_rx_event = 1;
+        pthread_cond_signal(&uart3_rx_cond);
+        pthread_mutex_unlock(&uart3_mutex);
+    }
+
+    return NULL;
+}
+
+/* 发送完一帧后调用 emsg_tx_done, 相当于DMA发送完成中断 */
+static void* uart3_tx_thread(void *arg)
+{
+    const uint8_t *data;
+    uint32_t len;
+    ssize_t ret;
+
+
+    (void)arg;
+    prctl(PR_SET_NAME, (unsigned long)"emsg_tx", 0, 0, 0);
+
+    for (;;)
+    {
+        pthread_mutex_lock(&uart3_mutex);
+        while (NULL == uart3_tx_data)
+            pthread_cond_wait(&uart3_tx_cond, &uart3_mutex);
+        data = uart3_tx_data;
+        len = uart3_tx_len;
+        pthread_mutex_unlock(&uart3_mutex);
+
+        while (len)
+        {
+            ret = write(pty_fd, data, len);
+            if (0 > ret)
+            {
+                if (EINTR == errno)
+                    continue;
+                break;
+            }
+            data += ret;
+            len -= ret;
+        }
+
+        pthread_mutex_lock(&uart3_mutex);
+        uart3_tx_data = NULL;
+        pthread_mutex_unlock(&uart3_mutex);
+        emsg_tx_done(uart3_conn_id);
+    }
+
+    return NULL;
+}
+
+int emsg_user_init(void)
+{
+    struct termios tio;
+    pthread_t tid;
+
+    pty_fd = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (0 > pty_fd)
+        return -1;
+    if (grantpt(pty_fd) || unlockpt(pty_fd) || ptsname_r(pty_fd, pty_name, sizeof(pty_name)))
+    {
+        close(pty_fd);
+        pty_fd = -1;
+        return -1;
+    }
+
+    /* 原始模式, 不处理换行和回显 */
+    pty_slave_fd = open(pty_name, O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if ((0 <= pty_slave_fd) && (0 == tcgetattr(pty_slave_fd, &tio)))
+    {
+        cfmakeraw(&tio);
+        tcsetattr(pty_slave_fd, TCSANOW, &tio);
+    }
+
+    if (   pthread_create(&tid, NULL, uart3_rx_thread, NULL)
+        || pthread_create(&tid, NULL, uart3_tx_thread, NULL))
+        return -1;
+
+    log_printf("--EMSG-- uart3: %s\n", pty_name);
+    return 0;
+}
+
+const char* emsg_user_pty_name(void)
+{
+    return pty_name;
+}
+
+/* 最多等待 UART3_WAIT_MS, 有数据时处理到读线程写入的位置 */
+void emsg_user_task(void)
+{
+    struct timespec ts;
+    uint32_t wr;
+    uint32_t total;
+    uint8_t event;
+
+    pthread_mutex_lock(&uart3_mutex);
+    if (0 == uart3_rx_event)
+    {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += UART3_WAIT_MS * 1000000;
+        if (1000000000 <= ts.tv_nsec)
+        {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&uart3_rx_cond, &uart3_mutex, &ts);
+    }
+    event = uart3_rx_event;
+    uart3_rx_event = 0;
+    wr = uart3_rx_wr;
+    total = uart3_rx_total;
+    pthread_mutex_unlock(&uart3_mutex);
+
+    if (0 == event)
+        return;
+    /* 被读线程套圈, 缓冲区中未处理的数据已经被覆盖, 丢弃 */
+    if (sizeof(uart3_rx_dma_buf) <= total - uart3_rx_pos)
+    {
+        uart3_rx_overruns++;
+        uart3_rx_rd = wr;
+    }
+    uart3_rx_pos = total;
+    emsg_recv_ring(uart3_conn_id, uart3_rx_dma_buf, sizeof(uart3_rx_dma_buf), &uart3_rx_rd, wr);
+}
+
+/* 交给写线程后立即返回 */
+uint32_t uart3_sender(const uint8_t *data, uint32_t len)
+{
+    pthread_mutex_lock(&uart3_mutex);
+    if (uart3_tx_data)
+    {
+        pthread_mutex_unlock(&uart3_mutex);
+        return 0;
+    }
+    uart3_tx_data = data;
+    uart3_tx_len = len;
+    pthread_cond_signal(&uart3_tx_cond);
+    pthread_mutex_unlock(&uart3_mutex);
+    return len;
+}
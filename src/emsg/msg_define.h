@@ -8,5 +8,15 @@
 #define MSG_ID_TEST      100
 #define MSG_ID_TEST_ACK  101
 
+/*
+ * 读取flash日志
+ * 请求: | seq(4) | offset(4) |, 为空时从最旧的记录开始
+ * 应答: | 下一次请求的 seq(4) | offset(4) | 记录... |, 没有记录时表示已读完
+ *   记录: | len(1) | type(1) | tick(4) | data(len) |
+ * 多字节均为大端
+ */
+#define MSG_ID_FLOG_READ      110
+#define MSG_ID_FLOG_READ_ACK  111
+
 
 #endif
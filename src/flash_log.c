@@ -0,0 +1,337 @@
+#include "flash_log.h"
+#include "stm32_flash.h"
+#include "stm32l4xx_hal.h"
+#include <string.h>
+
+
+
+
+#ifndef FLOG_ADDR
+#define FLOG_ADDR  (FLASH_BASE + FLASH_SIZE - FLOG_PAGE_COUNT * FLASH_PAGE_SIZE)
+#endif
+#define FLOG_MAGIC        0x474f4c46
+#define FLOG_BUF_SIZE     256   /* RAM中待写入的记录 */
+#define FLOG_BATCH_SIZE   64    /* 攒够这么多字节后写入 */
+#define FLOG_FLUSH_MS     1000  /* 最长延迟 */
+
+#define PAGE_ADDR(i)      (FLOG_ADDR + (i) * FLASH_PAGE_SIZE)
+#define RECORD_SIZE(len)  (sizeof(flog_record_t) + (((len) + 7) & (~((unsigned int)0x7))))
+
+#define FLOG_LOCK(primask)    do{(primask) = __get_PRIMASK(); __disable_irq();}while(0)
+#define FLOG_UNLOCK(primask)  __set_PRIMASK(primask)
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t seq;
+}flog_page_header_t;
+
+typedef struct
+{
+    uint16_t len;  /* 0xffff 表示未写入 */
+    uint8_t type;
+    uint8_t chk;
+    uint32_t tick;
+}flog_record_t;
+
+static unsigned char flog_inited = 0;
+static unsigned int flog_page;  /* 当前写入的页 */
+static unsigned int flog_seq;   /* 当前页的 seq */
+static unsigned int flog_head;  /* 当前页中下一条记录的偏移 */
+
+static uint64_t flog_buf[FLOG_BUF_SIZE / 8];
+static uint64_t flog_flush_buf[FLOG_BUF_SIZE / 8];
+static unsigned int flog_buf_len = 0;
+static unsigned int flog_buf_ts = 0;
+static unsigned int flog_flush_len = 0;  /* flog_flush_buf 中的数据 */
+static unsigned int flog_flush_off = 0;  /* 写失败时停在这里, 下次从这里重试 */
+static unsigned int flog_retry_ts = 0;
+
+
+
+
+static unsigned char record_chk(const flog_record_t *record, const unsigned char *data)
+{
+    const unsigned char *p = (const unsigned char *)record;
+    unsigned char sum = 0;
+    unsigned int i;
+
+    sum = p[0] + p[1] + p[2] + p[4] + p[5] + p[6] + p[7];
+    for (i = 0; i < record->len; i++)
+        sum += data[i];
+    return ~sum;
+}
+
+/* 返回页的 seq, 无效页返回0 */
+static unsigned int page_seq(unsigned int page)
+{
+    const flog_page_header_t *header = (const flog_page_header_t *)PAGE_ADDR(page);
+
+    if (FLOG_MAGIC != header->magic)
+        return 0;
+    if ((0 == header->seq) || (0xffffffff == header->seq))
+        return 0;
+    return header->seq;
+}
+
+/* 跳过已写入的记录, 返回第一个空白位置的偏移 */
+static unsigned int page_scan(unsigned int page)
+{
+    const flog_record_t *record;
+    unsigned int offset = sizeof(flog_page_header_t);
+
+    while (offset + sizeof(flog_record_t) <= FLASH_PAGE_SIZE)
+    {
+        record = (const flog_record_t *)(PAGE_ADDR(page) + offset);
+        if (0xffff == record->len)
+            break;
+        /* 写坏的记录, 本页不再使用 */
+        if (FLOG_DATA_MAX < record->len)
+            return FLASH_PAGE_SIZE;
+        offset += RECORD_SIZE(record->len);
+    }
+    return (FLASH_PAGE_SIZE < offset) ? FLASH_PAGE_SIZE : offset;
+}
+
+static int page_new(void)
+{
+    flog_page_header_t header;
+    unsigned int page = (flog_page + 1) % FLOG_PAGE_COUNT;
+
+    header.magic = FLOG_MAGIC;
+    header.seq = flog_seq + 1;
+    if (0 == header.seq)
+        header.seq = 1;
+    if (flash_erase(PAGE_ADDR(page), FLASH_PAGE_SIZE))
+        return -1;
+    if (flash_write(PAGE_ADDR(page), &header, sizeof(header)))
+        return -1;
+
+    flog_page = page;
+    flog_seq = header.seq;
+    flog_head = sizeof(flog_page_header_t);
+    return 0;
+}
+
+/* 找 seq 所在的页, 没有返回-1 */
+static int page_find(unsigned int seq)
+{
+    unsigned int i;
+
+    for (i = 0; i < FLOG_PAGE_COUNT; i++)
+    {
+        if (seq == page_seq(i))
+            return i;
+    }
+    return -1;
+}
+
+/* 当前页之后第一个有效的页就是最旧的 */
+static unsigned int oldest_seq(void)
+{
+    unsigned int seq;
+    unsigned int i;
+
+    for (i = 1; i <= FLOG_PAGE_COUNT; i++)
+    {
+        seq = page_seq((flog_page + i) % FLOG_PAGE_COUNT);
+        if (seq)
+            return seq;
+    }
+    return flog_seq;
+}
+
+int flog_init(void)
+{
+    unsigned int seq;
+    unsigned int i;
+
+    if (flog_inited)
+        return 0;
+
+    /* 只读页头找最新的页, 再扫描这一页找写入位置 */
+    flog_seq = 0;
+    for (i = 0; i < FLOG_PAGE_COUNT; i++)
+    {
+        seq = page_seq(i);
+        if (0 == seq)
+            continue;
+        if ((0 == flog_seq) || (0 < (int)(seq - flog_seq)))
+        {
+            flog_seq = seq;
+            flog_page = i;
+        }
+    }
+
+    if (0 == flog_seq)
+    {
+        flog_page = FLOG_PAGE_COUNT - 1;
+        if (page_new())
+            return -1;
+    }
+    else
+    {
+        flog_head = page_scan(flog_page);
+    }
+
+    flog_inited = 1;
+    return 0;
+}
+
+int flog_write(unsigned char type, const void *data, unsigned int len)
+{
+    unsigned int primask;
+    flog_record_t *record;
+    unsigned int size;
+
+    if ((FLOG_DATA_MAX < len) || ((NULL == data) && len))
+        return -1;
+
+    size = RECORD_SIZE(len);
+    FLOG_LOCK(primask);
+    if (FLOG_BUF_SIZE - flog_buf_len < size)
+    {
+        FLOG_UNLOCK(primask);
+        return -1;
+    }
+    record = (flog_record_t *)(((unsigned char *)flog_buf) + flog_buf_len);
+    record->len = len;
+    record->type = type;
+    record->tick = HAL_GetTick();
+    memcpy(record + 1, data, len);
+    memset(((unsigned char *)(record + 1)) + len, 0xff, size - sizeof(flog_record_t) - len);
+    record->chk = record_chk(record, (const unsigned char *)(record + 1));
+    if (0 == flog_buf_len)
+        flog_buf_ts = record->tick;
+    flog_buf_len += size;
+    FLOG_UNLOCK(primask);
+
+    return 0;
+}
+
+/* 写 flog_flush_buf 中剩下的记录, 失败时保留未写入的部分 */
+static int flush_pending(void)
+{
+    const flog_record_t *record;
+    unsigned int size;
+
+    while (flog_flush_off < flog_flush_len)
+    {
+        record = (const flog_record_t *)(((unsigned char *)flog_flush_buf) + flog_flush_off);
+        size = RECORD_SIZE(record->len);
+        if (FLASH_PAGE_SIZE - flog_head < size)
+        {
+            if (page_new())
+                return -1;
+        }
+        /* 写失败的位置可能已经部分写入, 之后的记录读不到, 这一页不再使用, 这条记录下次写到新的页 */
+        if (flash_write(PAGE_ADDR(flog_page) + flog_head, record, size))
+        {
+            flog_head = FLASH_PAGE_SIZE;
+            return -1;
+        }
+        flog_head += size;
+        flog_flush_off += size;
+    }
+    return 0;
+}
+
+int flog_flush(void)
+{
+    unsigned int primask;
+
+    if (0 == flog_inited)
+        return -1;
+
+    /* 先写上次失败剩下的, 再取新的记录 */
+    if (flush_pending())
+        goto FAILED;
+
+    FLOG_LOCK(primask);
+    memcpy(flog_flush_buf, flog_buf, flog_buf_len);
+    flog_flush_len = flog_buf_len;
+    flog_flush_off = 0;
+    flog_buf_len = 0;
+    FLOG_UNLOCK(primask);
+
+    if (flush_pending())
+        goto FAILED;
+    return 0;
+
+FAILED:
+    flog_retry_ts = HAL_GetTick();
+    return -1;
+}
+
+void flog_task(void)
+{
+    unsigned int now = HAL_GetTick();
+
+    if (flog_flush_off < flog_flush_len)
+    {
+        /* 写失败后间隔一段时间再重试 */
+        if (FLOG_FLUSH_MS <= (unsigned int)(now - flog_retry_ts))
+            flog_flush();
+        return;
+    }
+    if (0 == flog_buf_len)
+        return;
+    if ((FLOG_BATCH_SIZE <= flog_buf_len) || (FLOG_FLUSH_MS <= (unsigned int)(now - flog_buf_ts)))
+        flog_flush();
+}
+
+int flog_read(flog_cursor_t *cursor, unsigned char *type, unsigned int *tick, void *buf, unsigned int size)
+{
+    const flog_record_t *record;
+    unsigned int limit;
+    unsigned int seq;
+    int page;
+
+    if ((0 == flog_inited) || (NULL == cursor))
+        return -1;
+
+    for (;;)
+    {
+        if (0 < (int)(cursor->seq - flog_seq))
+            return -1;
+        page = cursor->seq ? page_find(cursor->seq) : -1;
+        if (0 > page)
+        {
+            seq = oldest_seq();
+            /* 中间的页头损坏, 跳过这一页 */
+            if (cursor->seq && (0 < (int)(cursor->seq - seq)))
+                cursor->seq++;
+            /* 起始或已经被覆盖的页, 从最旧的记录开始 */
+            else
+                cursor->seq = seq;
+            cursor->offset = sizeof(flog_page_header_t);
+            continue;
+        }
+
+        limit = (page == flog_page) ? flog_head : FLASH_PAGE_SIZE;
+        if (cursor->offset < sizeof(flog_page_header_t))
+            cursor->offset = sizeof(flog_page_header_t);
+        while (cursor->offset + sizeof(flog_record_t) <= limit)
+        {
+            record = (const flog_record_t *)(PAGE_ADDR(page) + cursor->offset);
+            if ((0xffff == record->len) || (FLOG_DATA_MAX < record->len))
+                break;
+            cursor->offset += RECORD_SIZE(record->len);
+            if (record->chk != record_chk(record, (const unsigned char *)(record + 1)))
+                continue;
+
+            if (type)
+                *type = record->type;
+            if (tick)
+                *tick = record->tick;
+            if (buf)
+                memcpy(buf, record + 1, (size < record->len) ? size : record->len);
+            return record->len;
+        }
+
+        if (page == flog_page)
+            return -1;
+        cursor->seq++;
+        cursor->offset = sizeof(flog_page_header_t);
+    }
+}
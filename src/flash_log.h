@@ -0,0 +1,34 @@
+#ifndef _FLASH_LOG_H_
+#define _FLASH_LOG_H_
+
+
+/*
+ * 掉电保存的事件日志, 记录写在 FLOG_PAGE_COUNT 个flash页中循环使用
+ * 页头: | magic(4) | seq(4) |, seq 每换一页加1, 上电时根据 seq 找到最新的页
+ * 记录: | len(2) | type(1) | chk(1) | tick(4) | data(len) | 填充到8字节对齐 |
+ * flog_write 只写RAM, 由 flog_task 攒够一批或超时后按双字写入flash
+ */
+
+/* 日志区起始地址, 必须按页对齐, 默认使用flash最后 FLOG_PAGE_COUNT 页 */
+/* #define FLOG_ADDR  ((unsigned int)0x080FE000) */
+#ifndef FLOG_PAGE_COUNT
+#define FLOG_PAGE_COUNT  4
+#endif
+#define FLOG_DATA_MAX    120  /* 单条记录的最大数据长度 */
+
+typedef struct
+{
+    unsigned int seq;     /* 为0时从最旧的记录开始 */
+    unsigned int offset;
+}flog_cursor_t;
+
+extern int flog_init(void);
+extern int flog_write(unsigned char type, const void *data, unsigned int len);
+/* 立即写入RAM中的记录, 复位前或异常处理中调用 */
+extern int flog_flush(void);
+extern void flog_task(void);
+/* 按时间顺序读取, 返回数据长度(超过size的部分丢弃), 没有更多记录时返回-1 */
+extern int flog_read(flog_cursor_t *cursor, unsigned char *type, unsigned int *tick, void *buf, unsigned int size);
+
+
+#endif
@@ -1,20 +1,20 @@
 #include "j1939_service.h"
 #include "log.h"
+#include "trace.h"
+#include "ring_buffer_pow2.h"
 #include <string.h>
 #include "stm32l4xx_hal.h"
 
 
 
 
-#define LOGLEVEL_ERROR  1
-#define LOGLEVEL_INFO   2
-#define LOGLEVEL_DEBUG  3
-#define LOG(level, fmt, arg...)  do{if((level) <= j1939_log_level)log_printf("--J1939-- " fmt "\n", ##arg);}while(0)
+#define LOG(level, fmt, arg...)  LOG_PRINT(level, j1939_log_level, "--J1939-- " fmt "\n", ##arg)
 unsigned char j1939_log_level = LOGLEVEL_ERROR;
+LOG_MODULE_REGISTER("J1939", j1939_log_level)
 
 
 #ifndef CAN_MSG_COUNT_MAX
-#define CAN_MSG_COUNT_MAX       64
+#define CAN_MSG_COUNT_MAX       64  /* 必须是2的幂 */
 #endif
 #ifndef J1939_MSG_CB_MAX
 #define J1939_MSG_CB_MAX        32
@@ -84,9 +84,10 @@ typedef struct
 }j1939_large_msg_tx_info_t;
 
 
-static unsigned int can_msg_head = 0;
-static unsigned int can_msg_tail = 0;  /* 永远指向空节点 */
+/* 中断中放入, j1939_task 中取出 */
+RBUF_POW2_DEFINE(can_msg_ring, can_msg_t)
 static can_msg_t can_msg_ring_buf[CAN_MSG_COUNT_MAX] = {0};
+static can_msg_ring_t can_msg_ring = RBUF_POW2_INITIALIZER(can_msg_ring_buf, CAN_MSG_COUNT_MAX);
 static j1939_msg_cb_info_t j1939_msg_cb_list[J1939_MSG_CB_MAX] = {0};
 static j1939_large_msg_cb_info_t j1939_large_msg_cb_list[J1939_LARGE_MSG_CB_MAX] = {0};
 static j1939_large_msg_tx_info_t j1939_large_msg_tx_list[J1939_LARGE_MSG_TX_MAX] = {0};
@@ -153,19 +154,12 @@ int j1939_recv_can_msg(const can_msg_t *msg)
     if ((NULL == msg) || (8 < msg->dlc))
         return -1;
 
-    if ((can_msg_tail + 1 == can_msg_head) || ((0 == can_msg_head) && (CAN_MSG_COUNT_MAX - 1 == can_msg_tail)))
+    if (0 == can_msg_ring_put1(&can_msg_ring, *msg))
     {
         recv_error++;
         return -1;
     }
 
-    can_msg_ring_buf[can_msg_tail] = *msg;
-
-    if ((CAN_MSG_COUNT_MAX - 1) <= can_msg_tail)
-        can_msg_tail = 0;
-    else
-        can_msg_tail++;
-
     return 0;
 }
 
@@ -697,6 +691,7 @@ void j1939_task(void)
     if (J1939_TASK_PERIOD > ((unsigned int)(current_ts - last_ts)))
         return;
     last_ts = current_ts;
+    TRACE_BEGIN("j1939_task");
 
     if (recv_error)
     {
@@ -705,11 +700,11 @@ void j1939_task(void)
     }
 
     /* RX */
-    while (can_msg_head != can_msg_tail)
+    /* 最后一次 get 返回0时释放全部节点 */
+    while (can_msg_ring_get(&can_msg_ring, &can_msg, 1))
     {
-        can_msg = &can_msg_ring_buf[can_msg_head];
         if ((0 == can_msg->ide) || (can_msg->rtr))
-            goto CONTINUE;
+            continue;
 
         pdu = (j1939_pdu_t *)can_msg->extension_id;
         if (0xf0 <= pdu->pf)
@@ -737,12 +732,6 @@ void j1939_task(void)
         handle_tpcm_cts(&header, can_msg->data, can_msg->dlc);
         handle_tpcm_ack(&header, can_msg->data, can_msg->dlc);
         handle_tpcm_abort(&header, can_msg->data, can_msg->dlc);
-
-    CONTINUE:
-        if ((CAN_MSG_COUNT_MAX - 1) <= can_msg_head)
-            can_msg_head = 0;
-        else
-            can_msg_head++;
     }
 
     /* TX */
@@ -820,6 +809,7 @@ void j1939_task(void)
             j1939_large_msg_tx_list[i].ts = HAL_GetTick();
         }
     }
+    TRACE_END("j1939_task");
 }
 
 void HAL_CAN_RxFifo0MsgPendingCallback(CAN_HandleTypeDef *hcan)
@@ -31,16 +31,15 @@
 #include "key_service.h"
 #include <string.h>
 #include "log.h"
+#include "trace.h"
 #include "stm32u5xx_hal.h"
 
 
 
 
-#define LOGLEVEL_ERROR 1
-#define LOGLEVEL_INFO 2
-#define LOGLEVEL_DEBUG 3
-#define LOG(level, fmt, arg...)  do{if((level) <= keys_log_level)log_printf("--KEYS-- " fmt "\n", ##arg);}while(0)
+#define LOG(level, fmt, arg...)  LOG_PRINT(level, keys_log_level, "--KEYS-- " fmt "\n", ##arg)
 unsigned char keys_log_level = LOGLEVEL_INFO;
+LOG_MODULE_REGISTER("KEYS", keys_log_level)
 
 
 typedef struct
@@ -233,6 +232,7 @@ void key_task(void)
         return;
     key_changed = 0;
     task_ts = current_ts;
+    TRACE_BEGIN("key_task");
 
     for (i = 0; i < KEY_COUNT_MAX; i++)
     {
@@ -345,4 +345,5 @@ void key_task(void)
             continue;
         }
     }
+    TRACE_END("key_task");
 }
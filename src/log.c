@@ -1,45 +1,598 @@
 #include "log.h"
-#ifdef LOG_BUFFER_ENABLE
-#include "ring_buffer.h"
+#include "log_format.h"
+#ifdef LOG_BINARY_ENABLE
+#include "record_ring.h"
 #endif
+#include <string.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include "stm32u5xx_hal.h"
 
 
+#if defined(LOG_BINARY_ENABLE) && !defined(LOG_BUFFER_ENABLE)
+#error "LOG_BINARY_ENABLE requires LOG_BUFFER_ENABLE"
+#endif
+
 extern UART_HandleTypeDef huart1;
 #define LOG_UART_HANDLE huart1
 
+#define LOG_LINE_MAX     200
+#define LOG_BIN_SYNC     0xa5
+#define LOG_BIN_REC_MAX  96
+#define LOG_BIN_STR_MAX  32
+#define LOG_HEX_CHUNK    64  /* log_hexdump 每次写入的最大字节数 */
+
 #ifdef LOG_BUFFER_ENABLE
+/* 任务和任意优先级的中断都可以调用 log_printf, 缓冲区操作在关中断下进行 */
+#define LOG_LOCK(primask)    do{(primask) = __get_PRIMASK(); __disable_irq();}while(0)
+#define LOG_UNLOCK(primask)  __set_PRIMASK(primask)
+
+/*
+ * 多生产者缓冲区, 数据为 [rd, wr) 或回绕后的 [rd, wrap) + [0, wr)
+ * 单核上嵌套的写者总是后进先出, 最外层的写者提交时之前预留的都已写完, 此时发布到 pub
+ */
+typedef struct
+{
+    unsigned int rd;            /* 未发送数据的起点 */
+    unsigned int wr;            /* 下一次预留的位置 */
+    unsigned int wrap;          /* 回绕时第一段数据的终点 */
+    unsigned int pub;           /* 可以发送的终点 */
+    unsigned char wrapped;
+    unsigned char pub_wrapped;  /* pub 是否在回绕后的第二段 */
+    unsigned char writers;      /* 正在写入的数量 */
+    unsigned char pad;
+    unsigned int tx_len;        /* 正在DMA发送的长度, 0表示空闲 */
+}log_buf_t;
+
+static log_buf_t log_buf = {0};
+#ifdef LOG_BINARY_ENABLE
+static unsigned int log_bin_buf[500];
+static record_ring_t log_bin_rring = RRING_INITIALIZER(log_bin_buf, sizeof(log_bin_buf));
+static unsigned char uart_tx_buf[LOG_LINE_MAX + 56];
+static unsigned char *pending_rec = NULL;  /* 已取出但还没放进 uart_tx_buf 的记录 */
+static unsigned int pending_len;
+static unsigned int tx_retry_len = 0;      /* DMA启动失败, uart_tx_buf 中等待重发的长度 */
+#else
 static unsigned char uart_tx_buf[2000];
-static ring_buffer_t uart_tx_rb = RBUF_INITIALIZER(uart_tx_buf, sizeof(uart_tx_buf), 1);
+#endif
 #endif
 
 
-#if defined(LOG_BUFFER_ENABLE) && (USE_HAL_UART_REGISTER_CALLBACKS != 0)
-static void uart_tx_complete_cb(UART_HandleTypeDef *huart)
+#ifdef LOG_BINARY_ENABLE
+/* 跳过标志/宽度/精度/长度修饰, 返回转换字符的位置; 长度修饰: 0:int 'l' 'L'(ll) 'z' 'j' 't' */
+static const char* parse_spec(const char *f, char *length, unsigned char *stars)
+{
+    *length = 0;
+    *stars = 0;
+    while (('-' == *f) || ('+' == *f) || (' ' == *f) || ('#' == *f) || ('0' == *f))
+        f++;
+    if ('*' == *f)
+    {
+        (*stars)++;
+        f++;
+    }
+    while (('0' <= *f) && ('9' >= *f))
+        f++;
+    if ('.' == *f)
+    {
+        f++;
+        if ('*' == *f)
+        {
+            (*stars)++;
+            f++;
+        }
+        while (('0' <= *f) && ('9' >= *f))
+            f++;
+    }
+    if ('h' == *f)
+    {
+        f++;
+        if ('h' == *f)
+            f++;
+    }
+    else if ('l' == *f)
+    {
+        f++;
+        *length = 'l';
+        if ('l' == *f)
+        {
+            f++;
+            *length = 'L';
+        }
+    }
+    else if (('z' == *f) || ('j' == *f) || ('t' == *f) || ('L' == *f))
+    {
+        *length = *f++;
+    }
+    return f;
+}
+
+/* 按格式串把参数原样拷贝到out, 返回长度, 空间不够时剩余参数丢弃 */
+static unsigned int log_bin_encode(unsigned char *out, unsigned int size, const char *fmt, va_list arg)
+{
+    unsigned char *p = out;
+    unsigned char *end = out + size;
+    const char *f;
+    const char *s;
+    char length;
+    unsigned char stars;
+    union
+    {
+        int i;
+        long l;
+        long long ll;
+        size_t z;
+        void *ptr;
+        double d;
+    }v;
+    unsigned int n;
+    unsigned int len;
+
+
+    memcpy(p, &fmt, sizeof(fmt));
+    p += sizeof(fmt);
+
+    for (f = fmt; *f; f++)
+    {
+        if ('%' != *f)
+            continue;
+        if ('%' == *++f)
+            continue;
+
+        f = parse_spec(f, &length, &stars);
+        while (stars--)
+        {
+            v.i = va_arg(arg, int);
+            if (end - p < sizeof(int))
+                return (unsigned int)(p - out);
+            memcpy(p, &v.i, sizeof(int));
+            p += sizeof(int);
+        }
+
+        switch (*f)
+        {
+        case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+            if ('L' == length)
+            {
+                v.ll = va_arg(arg, long long);
+                n = sizeof(long long);
+            }
+            else if ('l' == length)
+            {
+                v.l = va_arg(arg, long);
+                n = sizeof(long);
+            }
+            else if (('z' == length) || ('j' == length) || ('t' == length))
+            {
+                v.z = va_arg(arg, size_t);
+                n = sizeof(size_t);
+            }
+            else
+            {
+                v.i = va_arg(arg, int);
+                n = sizeof(int);
+            }
+            break;
+        case 'p':
+            v.ptr = va_arg(arg, void *);
+            n = sizeof(void *);
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            v.d = va_arg(arg, double);
+            n = sizeof(double);
+            break;
+        case 's':
+            s = va_arg(arg, const char *);
+            if (NULL == s)
+                s = "(null)";
+            for (len = 0; (len < LOG_BIN_STR_MAX) && s[len]; len++)
+                ;
+            if (end - p < len + 1)
+                return (unsigned int)(p - out);
+            *p++ = (unsigned char)len;
+            memcpy(p, s, len);
+            p += len;
+            continue;
+        case 'n':
+            (void)va_arg(arg, void *);
+            continue;
+        default:
+            return (unsigned int)(p - out);
+        }
+
+        if (end - p < n)
+            return (unsigned int)(p - out);
+        memcpy(p, &v, n);
+        p += n;
+    }
+
+    return (unsigned int)(p - out);
+}
+
+/* 把一条二进制记录格式化成文本, 返回长度, 空间不够时返回大于size的值 */
+static unsigned int log_bin_format(char *out, unsigned int size, const unsigned char *rec, unsigned int rec_len)
+{
+    const unsigned char *end = rec + rec_len;
+    const char *fmt;
+    const char *f;
+    const char *start;
+    char spec[24];
+    char str[LOG_BIN_STR_MAX + 1];
+    char length;
+    char kind;
+    unsigned char stars;
+    unsigned int len = 0;
+    unsigned int n;
+    int star[2];
+    int ret;
+    union
+    {
+        int i;
+        long l;
+        long long ll;
+        size_t z;
+        void *ptr;
+        double d;
+    }v;
+
+
+    if (sizeof(fmt) > rec_len)
+        return 0;
+    memcpy(&fmt, rec, sizeof(fmt));
+    rec += sizeof(fmt);
+
+    for (f = fmt; *f; f++)
+    {
+        if ('%' != *f)
+        {
+            if (len < size)
+                out[len] = *f;
+            len++;
+            continue;
+        }
+
+        start = f;
+        if ('%' == *++f)
+        {
+            if (len < size)
+                out[len] = '%';
+            len++;
+            continue;
+        }
+        f = parse_spec(f, &length, &stars);
+        if (sizeof(spec) <= f - start + 1)
+            break;
+        memcpy(spec, start, f - start + 1);
+        spec[f - start + 1] = '\0';
+        for (n = 0; n < stars; n++)
+        {
+            if (end - rec < sizeof(int))
+                goto END;
+            memcpy(&star[n], rec, sizeof(int));
+            rec += sizeof(int);
+        }
+
+        switch (*f)
+        {
+        case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+            kind = length;
+            if ('L' == length)
+                n = sizeof(long long);
+            else if ('l' == length)
+                n = sizeof(long);
+            else if (('z' == length) || ('j' == length) || ('t' == length))
+                n = sizeof(size_t);
+            else
+                n = sizeof(int);
+            break;
+        case 'p':
+            kind = 'p';
+            n = sizeof(void *);
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            kind = 'f';
+            n = sizeof(double);
+            break;
+        case 's':
+            if ((end <= rec) || (end - rec < 1 + *rec))
+                goto END;
+            memcpy(str, rec + 1, *rec);
+            str[*rec] = '\0';
+            rec += 1 + *rec;
+            kind = 's';
+            n = 0;
+            break;
+        case 'n':
+            continue;
+        default:
+            goto END;
+        }
+
+        if (end - rec < n)
+            goto END;
+        memcpy(&v, rec, n);
+        rec += n;
+
+#define FORMAT_ARG(value) \
+        ((0 == stars)? snprintf((len < size)? (out + len): NULL, (len < size)? (size - len): 0, spec, value): \
+         (1 == stars)? snprintf((len < size)? (out + len): NULL, (len < size)? (size - len): 0, spec, star[0], value): \
+                       snprintf((len < size)? (out + len): NULL, (len < size)? (size - len): 0, spec, star[0], star[1], value))
+        if ('s' == kind)
+            ret = FORMAT_ARG(str);
+        else if ('p' == kind)
+            ret = FORMAT_ARG(v.ptr);
+        else if ('f' == kind)
+            ret = FORMAT_ARG(v.d);
+        else if ('L' == kind)
+            ret = FORMAT_ARG(v.ll);
+        else if ('l' == kind)
+            ret = FORMAT_ARG(v.l);
+        else if (('z' == kind) || ('j' == kind) || ('t' == kind))
+            ret = FORMAT_ARG(v.z);
+        else
+            ret = FORMAT_ARG(v.i);
+#undef FORMAT_ARG
+        if (0 < ret)
+            len += ret;
+    }
+
+END:
+    return len;
+}
+#endif
+
+static const char log_hex_lut[16] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'};
+
+#ifndef LOG_BINARY_ENABLE
+static int log_vsnprintf(char *out, unsigned int size, const char *fmt, va_list arg)
+{
+#ifdef LOG_FORMAT_LITE
+    va_list copy;
+    int len;
+
+    va_copy(copy, arg);
+    len = log_format_lite(out, size, fmt, copy);
+    va_end(copy);
+    if (0 <= len)
+        return len;
+#endif
+    return vsnprintf(out, size, fmt, arg);
+}
+#endif
+
+#if defined(LOG_BUFFER_ENABLE) && !defined(LOG_BINARY_ENABLE)
+/* 预留连续的len字节, 空间不够返回NULL */
+static unsigned char* log_reserve(unsigned int len)
+{
+    unsigned int primask;
+    unsigned int pos;
+
+    LOG_LOCK(primask);
+    if (log_buf.wrapped)
+    {
+        if (log_buf.rd - log_buf.wr <= len)
+            goto FULL;
+        pos = log_buf.wr;
+    }
+    else if (sizeof(uart_tx_buf) - log_buf.wr >= len)
+    {
+        pos = log_buf.wr;
+    }
+    else
+    {
+        if (log_buf.rd <= len)
+            goto FULL;
+        log_buf.wrapped = 1;
+        log_buf.wrap = log_buf.wr;
+        pos = 0;
+    }
+    log_buf.wr = pos + len;
+    log_buf.writers++;
+    LOG_UNLOCK(primask);
+    return uart_tx_buf + pos;
+
+FULL:
+    LOG_UNLOCK(primask);
+    return NULL;
+}
+
+/* 提交 log_reserve 预留的区域, len 可以小于预留的长度 */
+static void log_commit(unsigned char *p, unsigned int max, unsigned int len)
+{
+    unsigned int primask;
+    unsigned int pos = p - uart_tx_buf;
+    unsigned int end = pos + max;
+    unsigned int gap = max - len;
+
+    LOG_LOCK(primask);
+    if (gap)
+    {
+        /* 后面嵌套写入的数据都已提交, 整体前移填掉多余的空间 */
+        if (log_buf.wrapped && (pos >= log_buf.rd))
+        {
+            memmove(p + len, p + max, log_buf.wrap - end);
+            log_buf.wrap -= gap;
+        }
+        else
+        {
+            memmove(p + len, p + max, log_buf.wr - end);
+            log_buf.wr -= gap;
+        }
+    }
+    if (0 == --log_buf.writers)
+    {
+        log_buf.pub = log_buf.wr;
+        log_buf.pub_wrapped = log_buf.wrapped;
+    }
+    LOG_UNLOCK(primask);
+}
+
+/* 在锁内调用, 返回下一段可以发送的连续数据长度 */
+static unsigned int log_tx_span(void)
 {
+    if (log_buf.wrapped && (log_buf.rd == log_buf.wrap))
+    {
+        log_buf.rd = 0;
+        log_buf.wrapped = 0;
+        if (!log_buf.pub_wrapped)
+            log_buf.pub = 0;
+        log_buf.pub_wrapped = 0;
+    }
+    if (log_buf.wrapped && log_buf.pub_wrapped)
+        return log_buf.wrap - log_buf.rd;
+    return log_buf.pub - log_buf.rd;
+}
+#endif
+
+#ifdef LOG_BINARY_ENABLE
+/* 把记录格式化到 uart_tx_buf, 返回长度 */
+static unsigned int log_tx_fill(void)
+{
+    unsigned int len = 0;
+    unsigned int n;
+
+    for (;;)
+    {
+        if (NULL == pending_rec)
+        {
+            pending_len = rring_get(&log_bin_rring, &pending_rec);
+            if (NULL == pending_rec)
+                break;
+        }
+
+#ifdef LOG_BINARY_RAW
+        n = pending_len + 2;
+        if (sizeof(uart_tx_buf) - len < n)
+        {
+            if (len)
+                break;
+            pending_len = sizeof(uart_tx_buf) - 2;
+            n = sizeof(uart_tx_buf);
+        }
+        uart_tx_buf[len] = LOG_BIN_SYNC;
+        uart_tx_buf[len + 1] = (unsigned char)pending_len;
+        memcpy(uart_tx_buf + len + 2, pending_rec, pending_len);
+#else
+        n = log_bin_format((char *)uart_tx_buf + len, sizeof(uart_tx_buf) - len, pending_rec, pending_len);
+        if (sizeof(uart_tx_buf) - len < n)
+        {
+            if (len)
+                break;
+            n = sizeof(uart_tx_buf) - 1;
+        }
+#endif
+        len += n;
+        pending_rec = NULL;
+    }
+    if (NULL == pending_rec)
+        rring_release(&log_bin_rring);
+
+    return len;
+}
+#endif
+
+#ifdef LOG_BUFFER_ENABLE
+/*
+ * 启动下一次DMA发送, done 为1表示上一次发送完成
+ * tx_len 在锁内置位, 保证同一时间只有一个上下文启动DMA, 不会丢失重新启动
+ */
+static void log_tx_next(unsigned char done)
+{
+    unsigned int primask;
+    unsigned int len;
+#ifdef LOG_BINARY_ENABLE
+
+    LOG_LOCK(primask);
+    if ((0 == done) && log_buf.tx_len)
+    {
+        LOG_UNLOCK(primask);
+        return;
+    }
+    log_buf.tx_len = 1;
+    LOG_UNLOCK(primask);
+
+    len = tx_retry_len;
+    tx_retry_len = 0;
+    for (;;)
+    {
+        if (0 == len)
+            len = log_tx_fill();
+        LOG_LOCK(primask);
+        if (len || ((NULL == pending_rec) && (log_bin_rring.cur == log_bin_rring.tail)))
+        {
+            log_buf.tx_len = len;
+            LOG_UNLOCK(primask);
+            break;
+        }
+        LOG_UNLOCK(primask);
+    }
+    /* 串口还没初始化或处于错误状态时不会有完成中断, 留到下一次 log_printf 重发 */
+    if (len && (HAL_OK != HAL_UART_Transmit_DMA(&LOG_UART_HANDLE, uart_tx_buf, len)))
+    {
+        tx_retry_len = len;
+        LOG_LOCK(primask);
+        log_buf.tx_len = 0;
+        LOG_UNLOCK(primask);
+    }
+#else
     unsigned char *p;
-    unsigned int count;
 
-    count = rbuf_get(&uart_tx_rb, &p, uart_tx_rb.member_count);
-    if (count)
-        HAL_UART_Transmit_DMA(&LOG_UART_HANDLE, p, count * 1);
+    LOG_LOCK(primask);
+    if (done)
+    {
+        log_buf.rd += log_buf.tx_len;
+        log_buf.tx_len = 0;
+    }
+    if (log_buf.tx_len)
+    {
+        LOG_UNLOCK(primask);
+        return;
+    }
+    len = log_tx_span();
+    log_buf.tx_len = len;
+    p = uart_tx_buf + log_buf.rd;
+    LOG_UNLOCK(primask);
+
+    /* 回绕时先发第一段, 第二段在发送完成中断里接着发 */
+    if (len && (HAL_OK != HAL_UART_Transmit_DMA(&LOG_UART_HANDLE, p, len)))
+    {
+        /* 不推进 rd, 下一次 log_printf 重发这一段 */
+        LOG_LOCK(primask);
+        log_buf.tx_len = 0;
+        LOG_UNLOCK(primask);
+    }
+#endif
+}
+#endif
+
+#if defined(LOG_BUFFER_ENABLE) && (USE_HAL_UART_REGISTER_CALLBACKS != 0)
+static void uart_tx_complete_cb(UART_HandleTypeDef *huart)
+{
+    log_tx_next(1);
 }
 #endif
 
 #if defined(LOG_BUFFER_ENABLE) && (USE_HAL_UART_REGISTER_CALLBACKS == 0)
+#ifdef LOG_UART_TX_CPLT_OTHER
+extern void LOG_UART_TX_CPLT_OTHER(UART_HandleTypeDef *huart);
+#endif
+/* 所有串口共用这一个回调 */
 void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
 {
-    unsigned char *p;
-    unsigned int count;
-
-    count = rbuf_get(&uart_tx_rb, &p, uart_tx_rb.member_count);
-    if (count)
-        HAL_UART_Transmit_DMA(&LOG_UART_HANDLE, p, count * 1);
+    if (&LOG_UART_HANDLE == huart)
+        log_tx_next(1);
+#ifdef LOG_UART_TX_CPLT_OTHER
+    else
+        LOG_UART_TX_CPLT_OTHER(huart);
+#endif
 }
 #endif
 
+unsigned int log_tick_ms(void)
+{
+    return HAL_GetTick();
+}
+
 int log_init(void)
 {
 #if defined(LOG_BUFFER_ENABLE) && (USE_HAL_UART_REGISTER_CALLBACKS != 0)
@@ -49,31 +602,150 @@ int log_init(void)
     return 0;
 }
 
+#ifdef LOG_BINARY_ENABLE
+void log_printf(const char *fmt, ...)
+{
+    unsigned char buf[LOG_BIN_REC_MAX];
+    unsigned int primask;
+    va_list arg;
+    unsigned int len;
+    int ret;
+
+    va_start(arg, fmt);
+    len = log_bin_encode(buf, sizeof(buf), fmt, arg);
+    va_end(arg);
+
+    LOG_LOCK(primask);
+    ret = rring_put(&log_bin_rring, buf, len);
+    LOG_UNLOCK(primask);
+
+    if (0 == ret)
+        log_tx_next(0);
+}
+#else
 void log_printf(const char *fmt, ...)
 {
-    unsigned char buf[200];
+    unsigned char buf[LOG_LINE_MAX];
     va_list arg;
     int len;
 #ifdef LOG_BUFFER_ENABLE
     unsigned char *p;
-    unsigned int count;
+
+    /* 优先直接格式化到缓冲区, 连续空间不够时再走栈缓冲 */
+    p = log_reserve(sizeof(buf));
+    if (p)
+    {
+        va_start(arg, fmt);
+        len = log_vsnprintf((char *)p, sizeof(buf), fmt, arg);
+        va_end(arg);
+        if (0 > len)
+            len = 0;
+        if (sizeof(buf) <= len)
+            len = sizeof(buf) - 1;
+        log_commit(p, sizeof(buf), len);
+        log_tx_next(0);
+        return;
+    }
 #endif
 
     va_start(arg, fmt);
-    len = vsnprintf((char *)buf, sizeof(buf), fmt, arg);
+    len = log_vsnprintf((char *)buf, sizeof(buf), fmt, arg);
     va_end(arg);
+    if (0 > len)
+        return;
     if (sizeof(buf) <= len)
         len = sizeof(buf) - 1;
 
 #ifdef LOG_BUFFER_ENABLE
-    rbuf_put(&uart_tx_rb, buf, len, 0);
-    if (HAL_UART_STATE_READY == LOG_UART_HANDLE.gState)
+    /* 空间不够时整行丢弃, 不输出半行 */
+    p = log_reserve(len);
+    if (NULL == p)
+        return;
+    memcpy(p, buf, len);
+    log_commit(p, len, len);
+    log_tx_next(0);
+#else
+    HAL_UART_Transmit(&LOG_UART_HANDLE, buf, len, (len >> 3) + 4));
+#endif
+}
+#endif
+
+/* 每个字节输出 "xx ", 返回结束位置 */
+static char* log_hex_fill(char *out, const unsigned char *data, unsigned int len)
+{
+    while (len--)
     {
-        count = rbuf_get(&uart_tx_rb, &p, uart_tx_rb.member_count);
-        if (count)
-            HAL_UART_Transmit_DMA(&LOG_UART_HANDLE, p, count * 1);
+        out[0] = log_hex_lut[*data >> 4];
+        out[1] = log_hex_lut[*data & 0x0f];
+        out[2] = ' ';
+        out += 3;
+        data++;
     }
+    return out;
+}
+
+void log_hexdump(const char *prefix, const void *data, unsigned int len)
+{
+    const unsigned char *d = (const unsigned char *)data;
+    unsigned int n;
+    char *p;
+#ifdef LOG_BINARY_ENABLE
+    char buf[LOG_BIN_STR_MAX + 1];
+
+    /* 二进制日志的 %s 最多 LOG_BIN_STR_MAX 个字符, 分段记录 */
+    if (prefix)
+        log_printf("%s", prefix);
+    do
+    {
+        n = (LOG_BIN_STR_MAX / 3 < len) ? (LOG_BIN_STR_MAX / 3) : len;
+        p = log_hex_fill(buf, d, n);
+        if (n == len)
+            *p++ = '\n';
+        *p = '\0';
+        log_printf("%s", buf);
+        d += n;
+        len -= n;
+    }while (len);
+#elif defined(LOG_BUFFER_ENABLE)
+    unsigned int plen = prefix ? strlen(prefix) : 0;
+    unsigned int size;
+    unsigned char *r;
+
+    if (LOG_LINE_MAX < plen)
+        plen = LOG_LINE_MAX;
+    /* 直接写到预留的空间, 分段写入, 空间不够时丢弃剩余部分 */
+    do
+    {
+        n = (LOG_HEX_CHUNK < len) ? LOG_HEX_CHUNK : len;
+        size = plen + n * 3 + (n == len);
+        r = log_reserve(size);
+        if (NULL == r)
+            return;
+        if (plen)
+            memcpy(r, prefix, plen);
+        p = log_hex_fill((char *)r + plen, d, n);
+        if (n == len)
+            *p = '\n';
+        log_commit(r, size, size);
+        log_tx_next(0);
+        plen = 0;
+        d += n;
+        len -= n;
+    }while (len);
 #else
-    HAL_UART_Transmit(&LOG_UART_HANDLE, buf, len, (len >> 3) + 4));
+    char buf[LOG_HEX_CHUNK * 3 + 1];
+
+    if (prefix)
+        HAL_UART_Transmit(&LOG_UART_HANDLE, (unsigned char *)prefix, strlen(prefix), (strlen(prefix) >> 3) + 4);
+    do
+    {
+        n = (LOG_HEX_CHUNK < len) ? LOG_HEX_CHUNK : len;
+        p = log_hex_fill(buf, d, n);
+        if (n == len)
+            *p++ = '\n';
+        HAL_UART_Transmit(&LOG_UART_HANDLE, (unsigned char *)buf, p - buf, ((p - buf) >> 3) + 4);
+        d += n;
+        len -= n;
+    }while (len);
 #endif
 }
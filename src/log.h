@@ -3,7 +3,84 @@
 
 #define LOG_BUFFER_ENABLE
 
+/*
+ * 用内置的整数格式化代替 vsnprintf, 只支持 %d %i %u %x %X %c %s,
+ * 标志 '0' '-', 宽度, 长度 h hh l ll z, 遇到其他格式时整行退回 vsnprintf
+ */
+#define LOG_FORMAT_LITE
+
+/*
+ * 二进制日志, 需要 LOG_BUFFER_ENABLE
+ * log_printf 只记录格式串地址和原始参数, 在串口发送完成中断里再格式化
+ * 定义 LOG_BINARY_RAW 时直接输出二进制记录, 由主机端根据ELF中的格式串解码:
+ *   | 0xA5 | len(1) | fmt地址(sizeof(char *), 小端) | 参数 |
+ *   参数按格式串顺序排列, 整数/浮点按实际类型的大小(小端),
+ *   '*' 宽度/精度为int, %s 为 长度(1) + 字符串(不含'\0', 最多 LOG_BIN_STR_MAX)
+ */
+/* #define LOG_BINARY_ENABLE */
+/* #define LOG_BINARY_RAW */
+/*
+ * 开启 LOG_BUFFER_ENABLE 且没有使用 USE_HAL_UART_REGISTER_CALLBACKS 时 log.c 定义了 HAL_UART_TxCpltCallback,
+ * 其他串口的发送完成交给这个函数处理, 原型为 void fn(UART_HandleTypeDef *huart)
+ */
+/* #define LOG_UART_TX_CPLT_OTHER  uart3_tx_cplt_callback */
+
+#define LOGLEVEL_NONE   0
+#define LOGLEVEL_ERROR  1
+#define LOGLEVEL_INFO   2
+#define LOGLEVEL_DEBUG  3
+
+/* 编译期的最高等级, 高于此等级的日志调用会被编译器完全去掉 */
+#ifndef LOG_LEVEL_MAX
+#define LOG_LEVEL_MAX  LOGLEVEL_DEBUG
+#endif
+
+#ifndef LOG_MODULE_MAX
+#define LOG_MODULE_MAX  16
+#endif
+
+#define LOG_ENABLED(level, level_var)  (((level) <= LOG_LEVEL_MAX) && ((level) <= (level_var)))
+
+#define LOG_PRINT(level, level_var, fmt, arg...) \
+    do{if(LOG_ENABLED(level, level_var))log_printf(fmt, ##arg);}while(0)
+
+/* 模块中和 LOG 一样加上模块名前缀后使用, prefix 必须是常量字符串 */
+#define LOG_HEXDUMP(level, level_var, prefix, data, len) \
+    do{if(LOG_ENABLED(level, level_var))log_hexdump(prefix, data, len);}while(0)
+
+/* 每个调用点一个令牌桶, 每秒最多rate条, 最多连续burst条 */
+#define LOG_PRINT_LIMITED(level, level_var, rate, burst, fmt, arg...) \
+    do{static log_ratelimit_t _rl = {0}; if(LOG_ENABLED(level, level_var) && log_ratelimit(&_rl, rate, burst))log_printf(fmt, ##arg);}while(0)
+
+/* 模块的日志等级变量注册到统一的表中, 以便运行时按名字调整 */
+#define LOG_MODULE_REGISTER(_name, _level_var) \
+    static void __attribute__((constructor)) _level_var##_register(void) {log_register_module(_name, &(_level_var));}
+
+typedef struct
+{
+    unsigned int ts;
+    unsigned short tokens;
+    unsigned char inited;
+    unsigned char pad;
+}log_ratelimit_t;
+
 extern int log_init(void);
 extern void log_printf(const char *fmt, ...);
+/* 输出 prefix 和 data 的十六进制, 以换行结束, prefix 可以为NULL */
+extern void log_hexdump(const char *prefix, const void *data, unsigned int len);
+
+extern unsigned int log_tick_ms(void);
+extern int log_ratelimit(log_ratelimit_t *rl, unsigned int rate, unsigned int burst);
+extern int log_register_module(const char *name, unsigned char *level);
+/* name 为NULL时设置所有模块 */
+extern int log_set_level(const char *name, unsigned char level);
+extern int log_get_level(const char *name);
+extern const char* log_get_module_name(unsigned int index);
+
+#ifdef __linux__
+/* log_init 之前调用, path 为NULL时输出到 stdout, max_size 为0时不轮转 */
+extern int log_set_file(const char *path, unsigned int max_size, unsigned int max_files);
+extern int log_exit(void);
+#endif
 
 #endif
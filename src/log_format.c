@@ -0,0 +1,246 @@
+#include "log.h"
+#include "log_format.h"
+#include <string.h>
+#include <stddef.h>
+
+
+#ifdef LOG_FORMAT_LITE
+static const char log_hex_lut_lower[16] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'};
+static const char log_hex_lut_upper[16] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
+
+static const char log_dec_lut[200] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+/* 10^9 ~ 10^19 */
+static const unsigned long long log_pow10[11] =
+{
+    1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+    100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+    1000000000000000000ULL, 10000000000000000000ULL
+};
+
+/* 从end往前写十进制, 返回起始位置, 用乘法代替除以100 */
+static char* fmt_u32(char *end, unsigned int v)
+{
+    unsigned int q;
+
+    while (100 <= v)
+    {
+        q = (unsigned int)(((unsigned long long)v * 0x51eb851f) >> 37);
+        end -= 2;
+        end[0] = log_dec_lut[(v - q * 100) * 2];
+        end[1] = log_dec_lut[(v - q * 100) * 2 + 1];
+        v = q;
+    }
+    if (10 <= v)
+    {
+        end -= 2;
+        end[0] = log_dec_lut[v * 2];
+        end[1] = log_dec_lut[v * 2 + 1];
+    }
+    else
+    {
+        *--end = '0' + v;
+    }
+    return end;
+}
+
+/* 超过32位时高位逐位减10的幂, 避免调用64位除法 */
+static char* fmt_u64(char *end, unsigned long long v)
+{
+    char high[11];
+    char *p;
+    int n = 0;
+    int i;
+
+    if (0 == (v >> 32))
+        return fmt_u32(end, (unsigned int)v);
+
+    for (i = 10; i >= 0; i--)
+    {
+        high[n] = '0';
+        while (log_pow10[i] <= v)
+        {
+            v -= log_pow10[i];
+            high[n]++;
+        }
+        if (n || ('0' != high[n]))
+            n++;
+    }
+    p = fmt_u32(end, (unsigned int)v);
+    while (p > end - 9)
+        *--p = '0';
+    while (n)
+        *--p = high[--n];
+    return p;
+}
+
+static char* fmt_hex(char *end, unsigned long long v, const char *lut)
+{
+    do
+    {
+        *--end = lut[v & 0x0f];
+        v >>= 4;
+    }while (v);
+    return end;
+}
+
+int log_format_lite(char *out, unsigned int size, const char *fmt, va_list arg)
+{
+    char num[24];
+    char *end = num + sizeof(num);
+    const char *s;
+    unsigned long long v;
+    unsigned int pos = 0;
+    unsigned int width;
+    unsigned int total;
+    unsigned int n;
+    long long sv;
+    char length;
+    char left;
+    char pad;
+    char neg;
+    char c;
+
+#define PUT(ch)  do{if(pos < size)out[pos] = (ch); pos++;}while(0)
+    if (0 == size)
+        return -1;
+    size--;
+
+    while ((c = *fmt++))
+    {
+        if ('%' != c)
+        {
+            PUT(c);
+            continue;
+        }
+
+        left = 0;
+        pad = ' ';
+        for (;; fmt++)
+        {
+            if ('-' == *fmt)
+                left = 1;
+            else if ('0' == *fmt)
+                pad = '0';
+            else
+                break;
+        }
+        width = 0;
+        while (('0' <= *fmt) && (*fmt <= '9'))
+            width = width * 10 + (*fmt++ - '0');
+        length = 0;
+        if ('h' == *fmt)
+        {
+            length = -1;
+            if ('h' == *++fmt)
+            {
+                length = -2;
+                fmt++;
+            }
+        }
+        else if ('l' == *fmt)
+        {
+            length = 1;
+            if ('l' == *++fmt)
+            {
+                length = 2;
+                fmt++;
+            }
+        }
+        else if ('z' == *fmt)
+        {
+            length = 3;
+            fmt++;
+        }
+
+        neg = 0;
+        c = *fmt++;
+        switch (c)
+        {
+        case 'd':
+        case 'i':
+            switch (length)
+            {
+            case 1:  sv = va_arg(arg, long); break;
+            case 2:  sv = va_arg(arg, long long); break;
+            case 3:  sv = (long)va_arg(arg, size_t); break;
+            case -1: sv = (short)va_arg(arg, int); break;
+            case -2: sv = (signed char)va_arg(arg, int); break;
+            default: sv = va_arg(arg, int); break;
+            }
+            if (0 > sv)
+            {
+                neg = 1;
+                v = 0 - (unsigned long long)sv;
+            }
+            else
+            {
+                v = sv;
+            }
+            s = fmt_u64(end, v);
+            break;
+        case 'u':
+        case 'x':
+        case 'X':
+            switch (length)
+            {
+            case 1:  v = va_arg(arg, unsigned long); break;
+            case 2:  v = va_arg(arg, unsigned long long); break;
+            case 3:  v = va_arg(arg, size_t); break;
+            case -1: v = (unsigned short)va_arg(arg, unsigned int); break;
+            case -2: v = (unsigned char)va_arg(arg, unsigned int); break;
+            default: v = va_arg(arg, unsigned int); break;
+            }
+            if ('u' == c)
+                s = fmt_u64(end, v);
+            else
+                s = fmt_hex(end, v, ('x' == c) ? log_hex_lut_lower : log_hex_lut_upper);
+            break;
+        case 'c':
+            num[0] = (char)va_arg(arg, int);
+            s = num;
+            end = num + 1;
+            pad = ' ';
+            break;
+        case 's':
+            s = va_arg(arg, const char *);
+            if (NULL == s)
+                s = "(null)";
+            end = (char *)s + strlen(s);
+            pad = ' ';
+            break;
+        case '%':
+            PUT('%');
+            continue;
+        default:
+            return -1;
+        }
+
+        n = end - s;
+        end = num + sizeof(num);
+        total = n + neg;
+        if (left)
+            pad = ' ';
+        if (neg && ('0' == pad))
+            PUT('-');
+        if (0 == left)
+        {
+            for (; total < width; total++)
+                PUT(pad);
+        }
+        if (neg && (' ' == pad))
+            PUT('-');
+        while (n--)
+            PUT(*s++);
+        for (; total < width; total++)
+            PUT(' ');
+    }
+#undef PUT
+
+    out[(pos < size) ? pos : size] = '\0';
+    return pos;
+}
+#endif
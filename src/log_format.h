@@ -0,0 +1,13 @@
+#ifndef _LOG_FORMAT_H_
+#define _LOG_FORMAT_H_
+
+#include <stdarg.h>
+
+
+/*
+ * 只支持 %d %i %u %x %X %c %s %%, 标志 '0' '-', 宽度, 长度 h hh l ll z
+ * 其他格式返回-1, 由调用者改用 vsnprintf, 返回值和 vsnprintf 相同
+ */
+extern int log_format_lite(char *out, unsigned int size, const char *fmt, va_list arg);
+
+#endif
@@ -0,0 +1,150 @@
+#include "log.h"
+#include <string.h>
+#ifdef __linux__
+#include <time.h>
+#include <pthread.h>
+#else
+#include "stm32u5xx_hal.h"
+#endif
+
+
+
+
+/* log_ratelimit 可能在中断中调用, 令牌桶的更新和 log.c 一样在关中断下进行 */
+#ifdef __linux__
+static pthread_mutex_t log_rl_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define LOG_LOCK(primask)    do{(void)(primask); pthread_mutex_lock(&log_rl_mutex);}while(0)
+#define LOG_UNLOCK(primask)  pthread_mutex_unlock(&log_rl_mutex)
+#else
+#define LOG_LOCK(primask)    do{(primask) = __get_PRIMASK(); __disable_irq();}while(0)
+#define LOG_UNLOCK(primask)  __set_PRIMASK(primask)
+#endif
+
+typedef struct
+{
+    const char *name;
+    unsigned char *level;
+}log_module_t;
+
+static log_module_t log_module_list[LOG_MODULE_MAX] = {0};
+static unsigned int log_module_count = 0;
+
+
+#ifdef __linux__
+unsigned int log_tick_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned int)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+#endif
+
+int log_ratelimit(log_ratelimit_t *rl, unsigned int rate, unsigned int burst)
+{
+    unsigned int primask = 0;
+    unsigned int elapsed;
+    unsigned int now;
+    unsigned int add;
+    int ret;
+
+    if ((NULL == rl) || (0 == rate))
+        return 0;
+
+    now = log_tick_ms();
+    LOG_LOCK(primask);
+    if (0 == rl->inited)
+    {
+        rl->inited = 1;
+        rl->ts = now;
+        rl->tokens = burst;
+    }
+    else
+    {
+        /* 超过填满令牌桶所需的时间时直接填满, 避免乘法溢出 */
+        elapsed = now - rl->ts;
+        if (burst * 1000 / rate < elapsed)
+            add = burst;
+        else
+            add = elapsed * rate / 1000;
+        if (add)
+        {
+            rl->ts = now;
+            if (burst < rl->tokens + add)
+                rl->tokens = burst;
+            else
+                rl->tokens += add;
+        }
+    }
+
+    ret = 0;
+    if (rl->tokens)
+    {
+        rl->tokens--;
+        ret = 1;
+    }
+    LOG_UNLOCK(primask);
+    return ret;
+}
+
+int log_register_module(const char *name, unsigned char *level)
+{
+    unsigned int i;
+
+    if ((NULL == name) || (NULL == level))
+        return -1;
+
+    for (i = 0; i < log_module_count; i++)
+    {
+        if (0 == strcmp(log_module_list[i].name, name))
+        {
+            log_module_list[i].level = level;
+            return 0;
+        }
+    }
+    if (LOG_MODULE_MAX <= log_module_count)
+        return -1;
+
+    log_module_list[log_module_count].name = name;
+    log_module_list[log_module_count].level = level;
+    log_module_count++;
+    return 0;
+}
+
+int log_set_level(const char *name, unsigned char level)
+{
+    unsigned int i;
+    int ret = -1;
+
+    for (i = 0; i < log_module_count; i++)
+    {
+        if (name && strcmp(log_module_list[i].name, name))
+            continue;
+        *log_module_list[i].level = level;
+        ret = 0;
+    }
+    return ret;
+}
+
+int log_get_level(const char *name)
+{
+    unsigned int i;
+
+    if (NULL == name)
+        return -1;
+
+    for (i = 0; i < log_module_count; i++)
+    {
+        if (0 == strcmp(log_module_list[i].name, name))
+            return *log_module_list[i].level;
+    }
+    return -1;
+}
+
+/* 用于遍历已注册的模块, 超出范围返回NULL */
+const char* log_get_module_name(unsigned int index)
+{
+    if (log_module_count <= index)
+        return NULL;
+    return log_module_list[index].name;
+}
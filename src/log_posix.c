@@ -0,0 +1,391 @@
+/*
+ * Linux 下 log.h 的实现, 替代 log.c
+ * log_printf 格式化后放入无锁队列, 由后台线程批量 writev 到文件, 文件超过大小后轮转
+ * log_init 之前的日志直接输出到 stdout
+ */
+#include "log.h"
+#include "mpmc_ring.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <linux/limits.h>
+
+
+
+
+#ifndef LOG_SLOT_SIZE
+#define LOG_SLOT_SIZE    256   /* 每条日志占一个节点, 超长截断 */
+#endif
+#ifndef LOG_SLOT_COUNT
+#define LOG_SLOT_COUNT   1024  /* 必须是2的幂 */
+#endif
+#define LOG_BATCH_MAX    64    /* 不超过 IOV_MAX */
+#define LOG_HEX_CHUNK    64
+
+typedef struct
+{
+    unsigned short len;
+    char text[LOG_SLOT_SIZE - 2];
+}log_slot_t;
+
+static mpmc_ring_t log_ring;
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+static unsigned char log_inited = 0;
+static unsigned char should_run = 0;
+static pthread_t log_tid;
+
+static unsigned int log_seq = 0;      /* 每放入一条加1, 写线程在上面等待 */
+static unsigned int log_waiting = 0;  /* 写线程是否在等待 */
+static unsigned int log_dropped = 0;  /* 队列满丢弃的条数 */
+
+static char log_path[PATH_MAX] = {0};  /* 为空时输出到 stdout */
+static unsigned int log_max_size = 0;  /* 为0时不轮转 */
+static unsigned int log_max_files = 0;
+static int log_fd = -1;
+static unsigned char log_tty = 0;      /* 输出到终端时保留颜色 */
+static unsigned int log_file_size = 0;
+
+
+
+
+static int log_open(void)
+{
+    struct stat st;
+
+    if (0 == log_path[0])
+    {
+        log_fd = STDOUT_FILENO;
+        log_tty = isatty(log_fd);
+        log_file_size = 0;
+        return 0;
+    }
+
+    log_fd = open(log_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (0 > log_fd)
+    {
+        fprintf(stderr, "--LOG-- open %s failed: %s !\n", log_path, strerror(errno));
+        log_fd = STDOUT_FILENO;
+        log_tty = isatty(log_fd);
+        return -1;
+    }
+    log_tty = 0;
+    log_file_size = (0 == fstat(log_fd, &st)) ? (unsigned int)st.st_size : 0;
+    return 0;
+}
+
+/* path -> path.1 -> path.2 ... -> path.(max_files - 1), 最旧的被覆盖 */
+static void log_rotate(void)
+{
+    char from[PATH_MAX + 16];
+    char to[PATH_MAX + 16];
+    unsigned int i;
+
+    if (STDOUT_FILENO != log_fd)
+        close(log_fd);
+
+    if (1 >= log_max_files)
+    {
+        unlink(log_path);
+    }
+    else
+    {
+        for (i = log_max_files - 1; i > 1; i--)
+        {
+            snprintf(from, sizeof(from), "%s.%u", log_path, i - 1);
+            snprintf(to, sizeof(to), "%s.%u", log_path, i);
+            rename(from, to);
+        }
+        snprintf(to, sizeof(to), "%s.1", log_path);
+        rename(log_path, to);
+    }
+    log_open();
+}
+
+static void log_write(struct iovec *iov, int iovcnt)
+{
+    ssize_t ret;
+
+    while (0 < iovcnt)
+    {
+        ret = writev(log_fd, iov, iovcnt);
+        if (0 > ret)
+        {
+            if (EINTR == errno)
+                continue;
+            return;
+        }
+        log_file_size += ret;
+        /* 部分写入时跳过已写完的部分 */
+        while ((0 < iovcnt) && (iov->iov_len <= (size_t)ret))
+        {
+            ret -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (0 < iovcnt)
+        {
+            iov->iov_base = (char *)iov->iov_base + ret;
+            iov->iov_len -= ret;
+        }
+    }
+}
+
+/* 去掉 ESC [ ... 字母 形式的颜色控制, 返回新的长度 */
+static unsigned int log_strip_color(char *text, unsigned int len)
+{
+    char *end = text + len;
+    char *src;
+    char *dst;
+
+    src = memchr(text, '\e', len);
+    if (NULL == src)
+        return len;
+    dst = src;
+    while (src < end)
+    {
+        if (('\e' == src[0]) && (src + 1 < end) && ('[' == src[1]))
+        {
+            src += 2;
+            while ((src < end) && ((0x40 > *src) || (0x7e < *src)))
+                src++;
+            if (src < end)
+                src++;
+            continue;
+        }
+        *dst++ = *src++;
+    }
+    return dst - text;
+}
+
+static void log_wait(unsigned int seq)
+{
+    struct timespec ts = {1, 0};
+
+    __atomic_store_n(&log_waiting, 1, __ATOMIC_SEQ_CST);
+    if (seq == __atomic_load_n(&log_seq, __ATOMIC_SEQ_CST))
+        syscall(SYS_futex, &log_seq, FUTEX_WAIT_PRIVATE, seq, &ts, NULL, 0);
+    __atomic_store_n(&log_waiting, 0, __ATOMIC_SEQ_CST);
+}
+
+static void* log_writer(void *arg)
+{
+    static log_slot_t batch[LOG_BATCH_MAX];
+    struct iovec iov[LOG_BATCH_MAX];
+    char drop_buf[64];
+    unsigned int bytes;
+    unsigned int seq;
+    unsigned int dropped;
+    unsigned int n;
+    unsigned int i;
+
+
+    (void)arg;
+    prctl(PR_SET_NAME, (unsigned long)"log_writer", 0, 0, 0);
+
+    for (;;)
+    {
+        seq = __atomic_load_n(&log_seq, __ATOMIC_SEQ_CST);
+        n = mpmc_get(&log_ring, batch, LOG_BATCH_MAX);
+        if (0 == n)
+        {
+            /* 退出前写完队列里的日志 */
+            if (0 == __atomic_load_n(&should_run, __ATOMIC_ACQUIRE))
+                break;
+            log_wait(seq);
+            continue;
+        }
+
+        bytes = 0;
+        for (i = 0; i < n; i++)
+        {
+            if (0 == log_tty)
+                batch[i].len = log_strip_color(batch[i].text, batch[i].len);
+            iov[i].iov_base = batch[i].text;
+            iov[i].iov_len = batch[i].len;
+            bytes += batch[i].len;
+        }
+        if (log_max_size && log_file_size && (log_max_size < log_file_size + bytes))
+            log_rotate();
+        log_write(iov, n);
+
+        dropped = __atomic_exchange_n(&log_dropped, 0, __ATOMIC_RELAXED);
+        if (dropped)
+        {
+            iov[0].iov_base = drop_buf;
+            iov[0].iov_len = snprintf(drop_buf, sizeof(drop_buf), "--LOG-- %u lines dropped !\n", dropped);
+            log_write(iov, 1);
+        }
+    }
+
+    return NULL;
+}
+
+static void log_put(log_slot_t *slot)
+{
+    if (0 == __atomic_load_n(&log_inited, __ATOMIC_ACQUIRE))
+    {
+        if (0 == isatty(STDOUT_FILENO))
+            slot->len = log_strip_color(slot->text, slot->len);
+        fwrite(slot->text, 1, slot->len, stdout);
+        return;
+    }
+
+    if (0 == mpmc_put(&log_ring, slot, 1))
+    {
+        __atomic_add_fetch(&log_dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    __atomic_add_fetch(&log_seq, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&log_waiting, __ATOMIC_SEQ_CST))
+        syscall(SYS_futex, &log_seq, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+int log_set_file(const char *path, unsigned int max_size, unsigned int max_files)
+{
+    pthread_mutex_lock(&log_mutex);
+    if (log_inited)
+    {
+        pthread_mutex_unlock(&log_mutex);
+        return -1;
+    }
+    if (path)
+    {
+        if (sizeof(log_path) <= strlen(path))
+        {
+            pthread_mutex_unlock(&log_mutex);
+            return -1;
+        }
+        strcpy(log_path, path);
+    }
+    else
+    {
+        log_path[0] = 0;
+    }
+    log_max_size = max_size;
+    log_max_files = max_files;
+    pthread_mutex_unlock(&log_mutex);
+    return 0;
+}
+
+int log_init(void)
+{
+    pthread_mutex_lock(&log_mutex);
+    if (log_inited)
+    {
+        pthread_mutex_unlock(&log_mutex);
+        return 0;
+    }
+
+    /* 队列只分配一次, log_exit 时可能还有生产者在访问 */
+    if ((NULL == log_ring.cells) && mpmc_init(&log_ring, LOG_SLOT_COUNT, sizeof(log_slot_t)))
+    {
+        pthread_mutex_unlock(&log_mutex);
+        return -1;
+    }
+    log_open();
+    should_run = 1;
+    if (pthread_create(&log_tid, NULL, log_writer, NULL))
+    {
+        should_run = 0;
+        if (STDOUT_FILENO != log_fd)
+            close(log_fd);
+        pthread_mutex_unlock(&log_mutex);
+        return -1;
+    }
+    fflush(stdout);
+
+    __atomic_store_n(&log_inited, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&log_mutex);
+    return 0;
+}
+
+/* 写完队列中的日志后退出, 之后的日志直接输出到 stdout */
+int log_exit(void)
+{
+    pthread_mutex_lock(&log_mutex);
+    if (0 == log_inited)
+    {
+        pthread_mutex_unlock(&log_mutex);
+        return 0;
+    }
+
+    __atomic_store_n(&log_inited, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&should_run, 0, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&log_seq, 1, __ATOMIC_SEQ_CST);
+    syscall(SYS_futex, &log_seq, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    pthread_join(log_tid, NULL);
+
+    if (STDOUT_FILENO != log_fd)
+        close(log_fd);
+    log_fd = -1;
+    pthread_mutex_unlock(&log_mutex);
+    return 0;
+}
+
+void log_printf(const char *fmt, ...)
+{
+    log_slot_t slot;
+    va_list arg;
+    int len;
+
+    va_start(arg, fmt);
+    len = vsnprintf(slot.text, sizeof(slot.text), fmt, arg);
+    va_end(arg);
+    if (0 >= len)
+        return;
+    /* 截断时最后一个字节用作换行, 不和下一条连在一起 */
+    if (sizeof(slot.text) <= (unsigned int)len)
+    {
+        len = sizeof(slot.text);
+        slot.text[len - 1] = '\n';
+    }
+    slot.len = len;
+
+    log_put(&slot);
+}
+
+void log_hexdump(const char *prefix, const void *data, unsigned int len)
+{
+    static const char lut[16] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'};
+    const unsigned char *d = (const unsigned char *)data;
+    log_slot_t slot;
+    unsigned int plen = prefix ? strlen(prefix) : 0;
+    unsigned int n;
+    char *p;
+
+    if (sizeof(slot.text) - LOG_HEX_CHUNK * 3 - 1 < plen)
+        plen = sizeof(slot.text) - LOG_HEX_CHUNK * 3 - 1;
+    do
+    {
+        n = (LOG_HEX_CHUNK < len) ? LOG_HEX_CHUNK : len;
+        if (plen)
+            memcpy(slot.text, prefix, plen);
+        p = slot.text + plen;
+        len -= n;
+        while (n--)
+        {
+            p[0] = lut[*d >> 4];
+            p[1] = lut[*d & 0x0f];
+            p[2] = ' ';
+            p += 3;
+            d++;
+        }
+        if (0 == len)
+            *p++ = '\n';
+        slot.len = p - slot.text;
+        log_put(&slot);
+        plen = 0;
+    }while (len);
+}
@@ -0,0 +1,156 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "mirror_ring.h"
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+
+
+
+int mring_init(mirror_ring_t *ring, unsigned int size)
+{
+    long page_size;
+    unsigned char *addr;
+    int fd;
+
+
+    if ((NULL == ring) || (0 >= size) || (0x40000000 < size))
+        return -1;
+    ring->buf = NULL;
+
+    page_size = sysconf(_SC_PAGESIZE);
+    if (0 >= page_size)
+        return -1;
+    /* 索引自由增长, 大小取2的幂才能在回绕时保持连续 */
+    size--;
+    size |= size >> 1;
+    size |= size >> 2;
+    size |= size >> 4;
+    size |= size >> 8;
+    size |= size >> 16;
+    size++;
+    if (size < page_size)
+        size = page_size;
+
+    fd = memfd_create("mirror_ring", MFD_CLOEXEC);
+    if (0 > fd)
+        return -1;
+    if (0 != ftruncate(fd, size))
+        goto ERR;
+
+    /* 先占住两倍大小的地址空间, 再把同一个文件覆盖映射到前后两半 */
+    addr = (unsigned char *)mmap(NULL, size * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == addr)
+        goto ERR;
+    if (   (addr != mmap(addr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0))
+        || (addr + size != mmap(addr + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0)))
+    {
+        munmap(addr, size * 2);
+        goto ERR;
+    }
+    close(fd);
+
+    ring->buf = addr;
+    ring->size = size;
+    ring->head = 0;
+    ring->tail = 0;
+    return 0;
+
+ERR:
+    close(fd);
+    return -1;
+}
+
+void mring_exit(mirror_ring_t *ring)
+{
+    if ((NULL == ring) || (NULL == ring->buf))
+        return;
+
+    munmap(ring->buf, ring->size * 2);
+    ring->buf = NULL;
+}
+
+/* 返回可写的数量, *data 之后的count字节都可以直接写 */
+unsigned int mring_write_ptr(mirror_ring_t *ring, unsigned char **data)
+{
+    unsigned int tail;
+    unsigned int head;
+
+    if ((NULL == ring) || (NULL == ring->buf) || (NULL == data))
+        return 0;
+
+    tail = ring->tail;
+    head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    *data = ring->buf + (tail & (ring->size - 1));
+    return ring->size - (tail - head);
+}
+
+unsigned int mring_commit(mirror_ring_t *ring, unsigned int count)
+{
+    unsigned int tail;
+    unsigned int head;
+
+    if ((NULL == ring) || (NULL == ring->buf))
+        return 0;
+
+    tail = ring->tail;
+    head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (ring->size - (tail - head) < count)
+        return 0;
+    __atomic_store_n(&ring->tail, tail + count, __ATOMIC_RELEASE);
+    return count;
+}
+
+/* 返回可读的数量, *data 之后的count字节是连续的 */
+unsigned int mring_read_ptr(mirror_ring_t *ring, unsigned char **data)
+{
+    unsigned int tail;
+    unsigned int head;
+
+    if ((NULL == ring) || (NULL == ring->buf) || (NULL == data))
+        return 0;
+
+    head = ring->head;
+    tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    *data = ring->buf + (head & (ring->size - 1));
+    return tail - head;
+}
+
+unsigned int mring_consume(mirror_ring_t *ring, unsigned int count)
+{
+    unsigned int tail;
+    unsigned int head;
+
+    if ((NULL == ring) || (NULL == ring->buf))
+        return 0;
+
+    head = ring->head;
+    tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if (tail - head < count)
+        count = tail - head;
+    __atomic_store_n(&ring->head, head + count, __ATOMIC_RELEASE);
+    return count;
+}
+
+unsigned int mring_put(mirror_ring_t *ring, const void *data, unsigned int count, unsigned char full_mode)
+{
+    unsigned char *p;
+    unsigned int max;
+
+    if ((NULL == data) || (0 >= count))
+        return 0;
+
+    max = mring_write_ptr(ring, &p);
+    if (max < count)
+    {
+        if (full_mode)
+            return 0;
+        count = max;
+    }
+    if (0 == count)
+        return 0;
+    memcpy(p, data, count);
+    return mring_commit(ring, count);
+}
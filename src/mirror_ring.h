@@ -0,0 +1,29 @@
+#ifndef _MIRROR_RING_H_
+#define _MIRROR_RING_H_
+
+
+/*
+ * 虚拟内存镜像环形缓冲区 (Linux)
+ * 同一个memfd连续映射两次, 任意可读/可写区域在地址上都是连续的,
+ * 解析函数(emsg_recv, nmea_parse等)可以直接在缓冲区上运行, 不需要处理回绕
+ * 单生产者单消费者
+ */
+typedef struct
+{
+    unsigned char *buf;
+    unsigned int size;
+    unsigned int head;  /* 自由增长, 读位置 */
+    unsigned int tail;  /* 自由增长, 写位置 */
+}mirror_ring_t;
+
+/* size 向上取整到2的幂, 且不小于页大小 */
+extern int mring_init(mirror_ring_t *ring, unsigned int size);
+extern void mring_exit(mirror_ring_t *ring);
+extern unsigned int mring_write_ptr(mirror_ring_t *ring, unsigned char **data);
+extern unsigned int mring_commit(mirror_ring_t *ring, unsigned int count);
+extern unsigned int mring_read_ptr(mirror_ring_t *ring, unsigned char **data);
+extern unsigned int mring_consume(mirror_ring_t *ring, unsigned int count);
+extern unsigned int mring_put(mirror_ring_t *ring, const void *data, unsigned int count, unsigned char full_mode);
+
+
+#endif
@@ -0,0 +1,120 @@
+#include "mpmc_ring.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+#define CELL_SEQ(ring, pos)   ((unsigned int *)((ring)->cells + ((pos) & (ring)->mask) * (ring)->cell_size))
+#define CELL_DATA(ring, pos)  ((ring)->cells + ((pos) & (ring)->mask) * (ring)->cell_size + 8)
+
+
+int mpmc_init(mpmc_ring_t *ring, unsigned int member_count, unsigned int member_size)
+{
+    unsigned int i;
+
+    if ((NULL == ring) || (2 > member_count) || (member_count & (member_count - 1)) || (0 >= member_size))
+        return -1;
+
+    /* 节点: [seq][pad][data], data 8字节对齐 */
+    ring->cell_size = (8 + member_size + 7) & (~((unsigned int)0x7));
+    ring->cells = (unsigned char *)aligned_alloc(64, ((ring->cell_size * member_count) + 63) & (~((unsigned int)63)));
+    if (NULL == ring->cells)
+        return -1;
+    ring->member_size = member_size;
+    ring->mask = member_count - 1;
+    for (i = 0; i < member_count; i++)
+        *CELL_SEQ(ring, i) = i;
+    __atomic_store_n(&ring->enqueue_pos, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&ring->dequeue_pos, 0, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+void mpmc_exit(mpmc_ring_t *ring)
+{
+    if (NULL == ring)
+        return;
+
+    free(ring->cells);
+    ring->cells = NULL;
+}
+
+/* 返回实际放入的数量, 队列满时可能少于count */
+unsigned int mpmc_put(mpmc_ring_t *ring, const void *data, unsigned int count)
+{
+    unsigned int pos;
+    unsigned int seq;
+    unsigned int n;
+    unsigned int i;
+
+
+    if ((NULL == ring) || (NULL == ring->cells) || (NULL == data) || (0 >= count))
+        return 0;
+
+    pos = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED);
+    for (;;)
+    {
+        /* 连续可写的节点数 */
+        for (n = 0; n < count; n++)
+        {
+            seq = __atomic_load_n(CELL_SEQ(ring, pos + n), __ATOMIC_ACQUIRE);
+            if (seq != pos + n)
+                break;
+        }
+        if (0 == n)
+        {
+            if (0 > (int)(seq - pos))
+                return 0;
+            pos = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED);
+            continue;
+        }
+        if (__atomic_compare_exchange_n(&ring->enqueue_pos, &pos, pos + n, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            break;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        memcpy(CELL_DATA(ring, pos + i), ((const unsigned char *)data) + i * ring->member_size, ring->member_size);
+        __atomic_store_n(CELL_SEQ(ring, pos + i), pos + i + 1, __ATOMIC_RELEASE);
+    }
+    return n;
+}
+
+/* 返回实际取出的数量, 数据拷贝到buf */
+unsigned int mpmc_get(mpmc_ring_t *ring, void *buf, unsigned int count)
+{
+    unsigned int pos;
+    unsigned int seq;
+    unsigned int n;
+    unsigned int i;
+
+
+    if ((NULL == ring) || (NULL == ring->cells) || (NULL == buf) || (0 >= count))
+        return 0;
+
+    pos = __atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED);
+    for (;;)
+    {
+        for (n = 0; n < count; n++)
+        {
+            seq = __atomic_load_n(CELL_SEQ(ring, pos + n), __ATOMIC_ACQUIRE);
+            if (seq != pos + n + 1)
+                break;
+        }
+        if (0 == n)
+        {
+            if (0 > (int)(seq - (pos + 1)))
+                return 0;
+            pos = __atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED);
+            continue;
+        }
+        if (__atomic_compare_exchange_n(&ring->dequeue_pos, &pos, pos + n, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            break;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        memcpy(((unsigned char *)buf) + i * ring->member_size, CELL_DATA(ring, pos + i), ring->member_size);
+        __atomic_store_n(CELL_SEQ(ring, pos + i), pos + i + ring->mask + 1, __ATOMIC_RELEASE);
+    }
+    return n;
+}
@@ -0,0 +1,26 @@
+#ifndef _MPMC_RING_H_
+#define _MPMC_RING_H_
+
+
+/* 多生产者多消费者有界队列 (Vyukov), 每个节点带序号 */
+typedef struct
+{
+    unsigned char *cells;
+    unsigned int cell_size;
+    unsigned int member_size;
+    unsigned int mask;
+    unsigned char pad0[64];
+    unsigned int enqueue_pos;
+    unsigned char pad1[64];
+    unsigned int dequeue_pos;
+    unsigned char pad2[64];
+}mpmc_ring_t;
+
+/* member_count 必须是2的幂 */
+extern int mpmc_init(mpmc_ring_t *ring, unsigned int member_count, unsigned int member_size);
+extern void mpmc_exit(mpmc_ring_t *ring);
+extern unsigned int mpmc_put(mpmc_ring_t *ring, const void *data, unsigned int count);
+extern unsigned int mpmc_get(mpmc_ring_t *ring, void *buf, unsigned int count);
+
+
+#endif
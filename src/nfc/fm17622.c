@@ -1,5 +1,6 @@
 #include "fm17622.h"
 #include "log.h"
+#include "trace.h"
 #include <string.h>
 #include "stm32u5xx_hal.h"
 
@@ -502,11 +503,9 @@ extern SPI_HandleTypeDef hspi1;
 #define FM17622_SPI_HANDLE hspi1
 #endif
 
-#define LOGLEVEL_ERROR 1
-#define LOGLEVEL_INFO  2
-#define LOGLEVEL_DEBUG 3
-#define LOG(level, fmt, arg...)  do{if((level)<=pcd_log_level)log_printf("--PCD-- " fmt "\n", ##arg);}while(0)
+#define LOG(level, fmt, arg...)  LOG_PRINT(level, pcd_log_level, "--PCD-- " fmt "\n", ##arg)
 unsigned char pcd_log_level = LOGLEVEL_INFO;
+LOG_MODULE_REGISTER("PCD", pcd_log_level)
 
 
 #ifdef FM17622_I2C
@@ -829,6 +828,7 @@ int pcd_send(unsigned char *send, unsigned int send_bits, unsigned char *recv, u
             return -1;
         }
     }
+    TRACE_BEGIN("pcd_send");
 
     /* 初始化 */
     fm17622_write_reg(CommandReg, RcvOff | CMD_Idle);
@@ -963,6 +963,7 @@ EXIT:
     fm17622_set_bits(ControlReg, TStopNow, TStopNow);
     fm17622_write_reg(CommandReg, CMD_Idle);
     fm17622_set_bits(BitFramingReg, StartSend, 0);
+    TRACE_END("pcd_send");
     return rst;
 }
 
@@ -311,10 +311,8 @@ typedef struct
 
 
 
-#define LOGLEVEL_ERROR 1
-#define LOGLEVEL_INFO  2
-#define LOGLEVEL_DEBUG 3
-#define LOG(level, fmt, arg...)  do{if((level)<=iso14443_log_level)log_printf("--TypeAB-- " fmt "\n", ##arg);}while (0)
+#define LOG(level, fmt, arg...)  LOG_PRINT(level, iso14443_log_level, "--TypeAB-- " fmt "\n", ##arg)
+#define LOG_HEX(level, prefix, data, len)  LOG_HEXDUMP(level, iso14443_log_level, "--TypeAB-- " prefix, data, len)
 
 
 #define GET_BCC(buf) ((buf)[0] ^ (buf)[1] ^ (buf)[2] ^ (buf)[3])
@@ -323,6 +321,7 @@ typedef struct
 
 
 unsigned char iso14443_log_level = LOGLEVEL_DEBUG;
+LOG_MODULE_REGISTER("TypeAB", iso14443_log_level)
 
 
 static unsigned int fsi2fs[] =
@@ -682,15 +681,7 @@ int typea_rats(card_info_t *info)
         LOG(LOGLEVEL_DEBUG, "<==  ATS: %02x", buf[0]);
         return 1;
     }
-    if (LOGLEVEL_DEBUG <= iso14443_log_level)
-    {
-        log_printf("--TypeAB-- <==  ATS: ");
-        for (i = 0; i < len; i++)
-        {
-            log_printf("%02x ", buf[i]);
-        }
-        log_printf("\n");
-    }
+    LOG_HEX(LOGLEVEL_DEBUG, "<==  ATS: ", buf, len);
     if ((ats->ta + ats->tb + ats->tc + sizeof(ATS_t)) > len)
     {
         LOG(LOGLEVEL_ERROR, "ats error, TL:%u, recv:%u, FSCI:%u, TA:%u, TB:%u, TC:%u !",
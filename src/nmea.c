@@ -6,11 +6,9 @@
 
 
 
-#define LOGLEVEL_ERROR 1
-#define LOGLEVEL_INFO 2
-#define LOGLEVEL_DEBUG 3
-#define LOG(level, fmt, arg...)  do{if((level) <= nmea_log_level)log_printf("--NMEA-- " fmt "\n", ##arg);}while(0)
+#define LOG(level, fmt, arg...)  LOG_PRINT(level, nmea_log_level, "--NMEA-- " fmt "\n", ##arg)
 unsigned char nmea_log_level = LOGLEVEL_INFO;
+LOG_MODULE_REGISTER("NMEA", nmea_log_level)
 
 
 static char* check_sentence(const char *str)
@@ -0,0 +1,195 @@
+#include "record_ring.h"
+#include <string.h>
+
+
+
+
+#define RRING_HDR_LEN   4
+#define RRING_PAD_MARK  0xffffffff
+#define RRING_ALIGN(x)  (((x) + 3) & (~3U))
+
+
+int rring_init(record_ring_t *ring, void *buf, unsigned int buf_size)
+{
+    if ((NULL == ring) || (NULL == buf) || (((unsigned long)buf) & 3) || (RRING_HDR_LEN * 2 > buf_size))
+        return -1;
+
+    ring->buf = (unsigned char *)buf;
+    ring->size = buf_size & (~3U);
+    ring->head = 0;
+    ring->cur = 0;
+    ring->tail = 0;
+    ring->reserved = 0;
+    ring->reserved_len = RRING_NO_RESERVE;
+    return 0;
+}
+
+/* 长度为len的记录放在哪里, 需要回绕时为0, 空间不够返回-1, 不修改ring */
+static int find_space(const record_ring_t *ring, unsigned int len)
+{
+    unsigned int need;
+    unsigned int head;
+    unsigned int tail;
+    unsigned int size;
+
+
+    size = ring->size;
+    head = ring->head;
+    tail = ring->tail;
+    if ((size <= head) || (size <= tail) || (size - RRING_HDR_LEN < len))
+        return -1;
+    need = RRING_HDR_LEN + RRING_ALIGN(len);
+
+    /* tail 不能追上 head, 否则无法区分空和满 */
+    if (tail < head)
+    {
+        if (tail + need >= head)
+            return -1;
+    }
+    else if ((tail + need > size) || ((tail + need == size) && (0 == head)))
+    {
+        if (need >= head)
+            return -1;
+        return 0;
+    }
+    return tail;
+}
+
+/* 预留一条长度为len的记录, 返回payload地址, 空间不够返回NULL */
+unsigned char* rring_reserve(record_ring_t *ring, unsigned int len)
+{
+    int pos;
+
+    if ((NULL == ring) || (NULL == ring->buf))
+        return NULL;
+
+    pos = find_space(ring, len);
+    if (0 > pos)
+        return NULL;
+    /* 回绕, 在尾部写入填充标记 */
+    if ((unsigned int)pos != ring->tail)
+        *((unsigned int *)(ring->buf + ring->tail)) = RRING_PAD_MARK;
+
+    ring->reserved = pos;
+    ring->reserved_len = len;
+    return ring->buf + pos + RRING_HDR_LEN;
+}
+
+/* 现在能否预留长度为len的记录, 只检查不修改ring */
+int rring_can_reserve(const record_ring_t *ring, unsigned int len)
+{
+    if ((NULL == ring) || (NULL == ring->buf))
+        return 0;
+    return 0 <= find_space(ring, len);
+}
+
+/* len 可以小于 reserve 时的长度, 超过时会覆盖未取出的记录 */
+int rring_commit(record_ring_t *ring, unsigned int len)
+{
+    unsigned int tail;
+
+    if ((NULL == ring) || (NULL == ring->buf))
+        return -1;
+    if ((RRING_NO_RESERVE == ring->reserved_len) || (ring->reserved_len < len))
+        return -1;
+
+    ring->reserved_len = RRING_NO_RESERVE;
+    tail = ring->reserved;
+    *((unsigned int *)(ring->buf + tail)) = len;
+    tail += RRING_HDR_LEN + RRING_ALIGN(len);
+    if (ring->size <= tail)
+        tail = 0;
+    ring->tail = tail;
+    return 0;
+}
+
+/* 整条放入, 空间不够时整条丢弃 */
+int rring_put(record_ring_t *ring, const void *data, unsigned int len)
+{
+    unsigned char *p;
+
+    if ((NULL == data) && len)
+        return -1;
+
+    p = rring_reserve(ring, len);
+    if (NULL == p)
+        return -1;
+    if (len)
+        memcpy(p, data, len);
+    return rring_commit(ring, len);
+}
+
+static int next_record(record_ring_t *ring, record_t *record)
+{
+    unsigned int cur = ring->cur;
+    unsigned int tail = ring->tail;
+    unsigned int len;
+
+    if (cur == tail)
+        return -1;
+    if ((ring->size - cur < RRING_HDR_LEN) || (RRING_PAD_MARK == *((unsigned int *)(ring->buf + cur))))
+    {
+        cur = 0;
+        if (cur == tail)
+            return -1;
+    }
+
+    len = *((unsigned int *)(ring->buf + cur));
+    record->data = ring->buf + cur + RRING_HDR_LEN;
+    record->len = len;
+    cur += RRING_HDR_LEN + RRING_ALIGN(len);
+    if (ring->size <= cur)
+        cur = 0;
+    ring->cur = cur;
+    return 0;
+}
+
+/* 释放上一次取出的记录并取出下一条, 返回payload长度, 没有记录时返回0且*data为NULL */
+unsigned int rring_get(record_ring_t *ring, unsigned char **data)
+{
+    record_t record;
+
+    if ((NULL == ring) || (NULL == ring->buf) || (NULL == data))
+        return 0;
+
+    ring->head = ring->cur;
+    if (next_record(ring, &record))
+    {
+        *data = NULL;
+        return 0;
+    }
+    *data = record.data;
+    return record.len;
+}
+
+/* 释放上一次取出的记录并最多取出count条, 返回条数 */
+unsigned int rring_get_batch(record_ring_t *ring, record_t *records, unsigned int count)
+{
+    unsigned int i;
+
+    if ((NULL == ring) || (NULL == ring->buf) || (NULL == records))
+        return 0;
+
+    ring->head = ring->cur;
+    for (i = 0; i < count; i++)
+    {
+        if (next_record(ring, &records[i]))
+            break;
+    }
+    return i;
+}
+
+void rring_release(record_ring_t *ring)
+{
+    if (NULL == ring)
+        return;
+
+    ring->head = ring->cur;
+}
+
+int rring_empty(const record_ring_t *ring)
+{
+    if ((NULL == ring) || (NULL == ring->buf))
+        return 1;
+    return ring->cur == ring->tail;
+}
@@ -0,0 +1,46 @@
+#ifndef _RECORD_RING_H_
+#define _RECORD_RING_H_
+
+
+/*
+ * 变长记录环形缓冲区, 每条记录为 [len(4字节)][payload], 按4字节对齐
+ * 尾部空间不够时写入填充标记并回绕, 记录在内存中总是连续的
+ * 单生产者单消费者, get 取出的记录在下一次 get/release 之前有效
+ */
+typedef struct
+{
+    unsigned char *buf;
+    unsigned int size;
+    unsigned int head;
+    unsigned int cur;
+    unsigned int tail;
+    unsigned int reserved;  /* reserve 返回的记录位置 */
+    unsigned int reserved_len;  /* reserve 的长度, 没有预留时为 RRING_NO_RESERVE */
+}record_ring_t;
+
+typedef struct
+{
+    unsigned char *data;
+    unsigned int len;
+}record_t;
+
+#define RRING_NO_RESERVE  0xffffffffU
+
+#define RRING_INITIALIZER(_buf, _buf_size) \
+    {.buf=(unsigned char*)(_buf),.size=(_buf_size)&(~3U),.head=0,.cur=0,.tail=0,.reserved=0, \
+     .reserved_len=RRING_NO_RESERVE}
+
+extern int rring_init(record_ring_t *ring, void *buf, unsigned int buf_size);
+extern unsigned char* rring_reserve(record_ring_t *ring, unsigned int len);
+extern int rring_can_reserve(const record_ring_t *ring, unsigned int len);
+/* 提交最近一次 reserve 的记录, 没有预留或 len 大于预留的长度返回-1 */
+extern int rring_commit(record_ring_t *ring, unsigned int len);
+extern int rring_put(record_ring_t *ring, const void *data, unsigned int len);
+extern unsigned int rring_get(record_ring_t *ring, unsigned char **data);
+extern unsigned int rring_get_batch(record_ring_t *ring, record_t *records, unsigned int count);
+extern void rring_release(record_ring_t *ring);
+/* 没有未取出的记录, 只读, 生产者放入后可能马上变为非空 */
+extern int rring_empty(const record_ring_t *ring);
+
+
+#endif
@@ -1,4 +1,5 @@
 #include "riff.h"
+#include "log.h"
 #include <stdio.h>
 #include <string.h>
 #include <endian.h>
@@ -103,8 +104,8 @@
 /* ---------------------------------------------------------------------------------------- */
 
 
-#define DEBUG(fmt, arg...)  printf("--RIFF-- %s: " fmt "\n", __func__, ##arg)
-#define ERROR(fmt, arg...)  printf("\e[1;31m--RIFF-- %s: " fmt "\e[0m\n", __func__, ##arg)
+#define DEBUG(fmt, arg...)  log_printf("--RIFF-- %s: " fmt "\n", __func__, ##arg)
+#define ERROR(fmt, arg...)  log_printf("\e[1;31m--RIFF-- %s: " fmt "\e[0m\n", __func__, ##arg)
 
 #pragma pack (1)
 
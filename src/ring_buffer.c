@@ -1,5 +1,12 @@
 #include "ring_buffer.h"
 #include <string.h>
+#ifdef RBUF_WAIT_ENABLE
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
 
 
 int rbuf_init(ring_buffer_t *ring_buf, void *buf, unsigned int buf_size, unsigned int member_size)
@@ -14,13 +21,156 @@ int rbuf_init(ring_buffer_t *ring_buf, void *buf, unsigned int buf_size, unsigne
     ring_buf->head = 0;
     ring_buf->cur = 0;
     ring_buf->tail = 0;
+#ifdef RBUF_STATS_ENABLE
+    memset(&ring_buf->stats, 0, sizeof(rbuf_stats_t));
+    ring_buf->sampling = 0;
+#endif
+#ifdef RBUF_WAIT_ENABLE
+    ring_buf->data_seq = 0;
+    ring_buf->space_seq = 0;
+    ring_buf->get_waiters = 0;
+    ring_buf->put_waiters = 0;
+#endif
     if (2 > ring_buf->member_count)
         return -1;
 
     return 0;
 }
 
-unsigned int rbuf_put(ring_buffer_t *ring_buf, const void *data, unsigned int count, unsigned char full_mode)
+#ifdef RBUF_STATS_ENABLE
+static void stats_put(ring_buffer_t *ring_buf, unsigned int request, unsigned int count)
+{
+    unsigned int used;
+
+    ring_buf->stats.puts++;
+    ring_buf->stats.put_members += count;
+    ring_buf->stats.dropped += request - count;
+    if (0 == count)
+        return;
+
+    if (ring_buf->tail >= ring_buf->head)
+        used = ring_buf->tail - ring_buf->head;
+    else
+        used = ring_buf->member_count - ring_buf->head + ring_buf->tail;
+    if (ring_buf->stats.high_water < used)
+        ring_buf->stats.high_water = used;
+
+#ifdef RBUF_STATS_TIMESTAMP
+    /* 同一时间只跟踪一个成员, 记录本次放入的最后一个 */
+    if (0 == ring_buf->sampling)
+    {
+        ring_buf->sample_pos = (0 == ring_buf->tail)? (ring_buf->member_count - 1): (ring_buf->tail - 1);
+        ring_buf->sample_ts = RBUF_STATS_TIMESTAMP();
+        ring_buf->sampling = 1;
+    }
+#endif
+}
+
+static void stats_get(ring_buffer_t *ring_buf, unsigned int start, unsigned int count)
+{
+#ifdef RBUF_STATS_TIMESTAMP
+    unsigned int ts;
+    unsigned int offset;
+#endif
+
+    (void)start;
+    if (0 == count)
+        return;
+    ring_buf->stats.gets++;
+    ring_buf->stats.get_members += count;
+
+#ifdef RBUF_STATS_TIMESTAMP
+    if (0 == ring_buf->sampling)
+        return;
+    if (ring_buf->sample_pos >= start)
+        offset = ring_buf->sample_pos - start;
+    else
+        offset = ring_buf->member_count - start + ring_buf->sample_pos;
+    if (offset >= count)
+        return;
+
+    ts = RBUF_STATS_TIMESTAMP() - ring_buf->sample_ts;
+    if (ring_buf->stats.residency_max < ts)
+        ring_buf->stats.residency_max = ts;
+    ring_buf->stats.residency_sum += ts;
+    ring_buf->stats.residency_count++;
+    ring_buf->sampling = 0;
+#endif
+}
+#define STATS_PUT(ring_buf, request, count)  stats_put(ring_buf, request, count)
+#define STATS_GET(ring_buf, start, count)    stats_get(ring_buf, start, count)
+#else
+#define STATS_PUT(ring_buf, request, count)  do{}while(0)
+#define STATS_GET(ring_buf, start, count)    do{}while(0)
+#endif
+
+#ifdef RBUF_WAIT_ENABLE
+static int futex_wait_until(unsigned int *addr, unsigned int val, const struct timespec *deadline)
+{
+    struct timespec now;
+    struct timespec ts;
+
+    if (NULL == deadline)
+    {
+        syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+        return 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ts.tv_sec = deadline->tv_sec - now.tv_sec;
+    ts.tv_nsec = deadline->tv_nsec - now.tv_nsec;
+    if (0 > ts.tv_nsec)
+    {
+        ts.tv_sec--;
+        ts.tv_nsec += 1000000000;
+    }
+    if (0 > ts.tv_sec)
+        return -1;
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, &ts, NULL, 0);
+    return 0;
+}
+
+static void get_deadline(struct timespec *deadline, int timeout_ms)
+{
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    deadline->tv_sec += timeout_ms / 1000;
+    deadline->tv_nsec += (timeout_ms % 1000) * 1000000;
+    if (1000000000 <= deadline->tv_nsec)
+    {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000;
+    }
+}
+
+/* old_tail 等于消费者的 cur 说明放入前是空的, 消费者可能在等待 */
+static void notify_data(ring_buffer_t *ring_buf, unsigned int old_tail)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (0 == __atomic_load_n(&ring_buf->get_waiters, __ATOMIC_SEQ_CST))
+        return;
+    if (old_tail != __atomic_load_n(&ring_buf->cur, __ATOMIC_SEQ_CST))
+        return;
+    __atomic_add_fetch(&ring_buf->data_seq, 1, __ATOMIC_SEQ_CST);
+    syscall(SYS_futex, &ring_buf->data_seq, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+static void notify_space(ring_buffer_t *ring_buf)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (0 == __atomic_load_n(&ring_buf->put_waiters, __ATOMIC_SEQ_CST))
+        return;
+    __atomic_add_fetch(&ring_buf->space_seq, 1, __ATOMIC_SEQ_CST);
+    syscall(SYS_futex, &ring_buf->space_seq, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+#define NOTIFY_DATA(ring_buf, old_tail)  notify_data(ring_buf, old_tail)
+#define NOTIFY_SPACE(ring_buf)           notify_space(ring_buf)
+#else
+#define NOTIFY_DATA(ring_buf, old_tail)  do{(void)(old_tail);}while(0)
+#define NOTIFY_SPACE(ring_buf)           do{}while(0)
+#endif
+
+
+static inline unsigned int do_put(ring_buffer_t *ring_buf, const void *data, unsigned int count, unsigned char full_mode)
 {
     unsigned char *buf;
     unsigned int member_size;
@@ -84,7 +234,21 @@ unsigned int rbuf_put(ring_buffer_t *ring_buf, const void *data, unsigned int co
     return count;
 }
 
-unsigned int rbuf_get(ring_buffer_t *ring_buf, unsigned char **data, unsigned int count)
+unsigned int rbuf_put(ring_buffer_t *ring_buf, const void *data, unsigned int count, unsigned char full_mode)
+{
+    unsigned int tail;
+    unsigned int n;
+
+    tail = ring_buf? ring_buf->tail: 0;
+    n = do_put(ring_buf, data, count, full_mode);
+    if (ring_buf)
+        STATS_PUT(ring_buf, count, n);
+    if (n)
+        NOTIFY_DATA(ring_buf, tail);
+    return n;
+}
+
+static inline unsigned int do_get(ring_buffer_t *ring_buf, unsigned char **data, unsigned int count)
 {
     unsigned char *buf;
     unsigned int member_count;
@@ -131,3 +295,226 @@ unsigned int rbuf_get(ring_buffer_t *ring_buf, unsigned char **data, unsigned in
     *data = buf + (head * ring_buf->member_size);
     return count;
 }
+
+unsigned int rbuf_get(ring_buffer_t *ring_buf, unsigned char **data, unsigned int count)
+{
+    unsigned int head;
+    unsigned int n;
+
+    head = ring_buf? ring_buf->head: 0;
+    n = do_get(ring_buf, data, count);
+    if (n)
+        STATS_GET(ring_buf, ring_buf->head, n);
+    if (ring_buf && (head != ring_buf->head))
+        NOTIFY_SPACE(ring_buf);
+    return n;
+}
+
+static unsigned int rbuf_writable(const ring_buffer_t *ring_buf)
+{
+    unsigned int member_count = ring_buf->member_count;
+    unsigned int head = ring_buf->head;
+    unsigned int tail = ring_buf->tail;
+
+    if (   (NULL == ring_buf->buf)
+        || (2 > member_count)
+        || (member_count <= head)
+        || (member_count <= tail))
+        return 0;
+
+    if (tail < head)
+        return head - tail - 1;
+    if (0 == head)
+        return member_count - tail - 1;
+    return member_count - tail;
+}
+
+unsigned int rbuf_reserve(ring_buffer_t *ring_buf, unsigned char **data, unsigned int count)
+{
+    unsigned int max;
+
+    if ((NULL == ring_buf) || (NULL == data) || (0 >= count))
+        return 0;
+
+    max = rbuf_writable(ring_buf);
+    if (0 == max)
+        return 0;
+    if (max < count)
+        count = max;
+    *data = ring_buf->buf + (ring_buf->tail * ring_buf->member_size);
+    return count;
+}
+
+unsigned int rbuf_commit(ring_buffer_t *ring_buf, unsigned int count)
+{
+    unsigned int tail;
+
+    if ((NULL == ring_buf) || (0 >= count))
+        return 0;
+    if (rbuf_writable(ring_buf) < count)
+        return 0;
+
+    tail = ring_buf->tail + count;
+    if (ring_buf->member_count <= tail)
+        tail = 0;
+    ring_buf->tail = tail;
+    STATS_PUT(ring_buf, count, count);
+    NOTIFY_DATA(ring_buf, (0 == tail)? (ring_buf->member_count - count): (tail - count));
+    return count;
+}
+
+unsigned int rbuf_peek2(ring_buffer_t *ring_buf, unsigned char **data1, unsigned int *count1, unsigned char **data2, unsigned int *count2)
+{
+    unsigned char *buf;
+    unsigned int member_size;
+    unsigned int member_count;
+    unsigned int cur;
+    unsigned int tail;
+
+
+    if ((NULL == ring_buf) || (NULL == data1) || (NULL == count1) || (NULL == data2) || (NULL == count2))
+        return 0;
+    *count1 = 0;
+    *count2 = 0;
+
+    buf = ring_buf->buf;
+    member_size = ring_buf->member_size;
+    member_count = ring_buf->member_count;
+    cur = ring_buf->cur;
+    tail = ring_buf->tail;
+    if (   (NULL == buf)
+        || (2 > member_count)
+        || (member_count <= cur)
+        || (member_count <= tail))
+        return 0;
+
+    if (cur == tail)
+        return 0;
+    *data1 = buf + (cur * member_size);
+    if (cur < tail)
+    {
+        *count1 = tail - cur;
+        return *count1;
+    }
+    *count1 = member_count - cur;
+    if (tail)
+    {
+        *data2 = buf;
+        *count2 = tail;
+    }
+    return *count1 + *count2;
+}
+
+unsigned int rbuf_skip(ring_buffer_t *ring_buf, unsigned int count)
+{
+    unsigned int member_count;
+    unsigned int cur;
+    unsigned int tail;
+    unsigned int max;
+
+    if (NULL == ring_buf)
+        return 0;
+
+    member_count = ring_buf->member_count;
+    cur = ring_buf->cur;
+    tail = ring_buf->tail;
+    if ((2 > member_count) || (member_count <= cur) || (member_count <= tail))
+        return 0;
+
+    max = (cur <= tail)? (tail - cur): (member_count - cur + tail);
+    if (max < count)
+        count = max;
+    STATS_GET(ring_buf, cur, count);
+    cur += count;
+    if (member_count <= cur)
+        cur -= member_count;
+    ring_buf->cur = cur;
+    ring_buf->head = cur;
+    if (count)
+        NOTIFY_SPACE(ring_buf);
+    return count;
+}
+
+int rbuf_get_stats(ring_buffer_t *ring_buf, rbuf_stats_t *stats, unsigned char reset)
+{
+#ifdef RBUF_STATS_ENABLE
+    if ((NULL == ring_buf) || (NULL == stats))
+        return -1;
+
+    memcpy(stats, &ring_buf->stats, sizeof(rbuf_stats_t));
+    if (reset)
+    {
+        memset(&ring_buf->stats, 0, sizeof(rbuf_stats_t));
+        ring_buf->sampling = 0;
+    }
+    return 0;
+#else
+    (void)ring_buf;
+    (void)stats;
+    (void)reset;
+    return -1;
+#endif
+}
+
+#ifdef RBUF_WAIT_ENABLE
+unsigned int rbuf_get_timed(ring_buffer_t *ring_buf, unsigned char **data, unsigned int count, int timeout_ms)
+{
+    struct timespec deadline;
+    unsigned int seq;
+    unsigned int n;
+    int ret;
+
+
+    if ((NULL == ring_buf) || (NULL == data) || (0 >= count))
+        return 0;
+
+    if (0 < timeout_ms)
+        get_deadline(&deadline, timeout_ms);
+    for (;;)
+    {
+        /* 先登记等待者和序号, 再检查数据, 防止丢失唤醒 */
+        __atomic_add_fetch(&ring_buf->get_waiters, 1, __ATOMIC_SEQ_CST);
+        seq = __atomic_load_n(&ring_buf->data_seq, __ATOMIC_SEQ_CST);
+        n = rbuf_get(ring_buf, data, count);
+        if (n || (0 == timeout_ms))
+        {
+            __atomic_sub_fetch(&ring_buf->get_waiters, 1, __ATOMIC_SEQ_CST);
+            return n;
+        }
+        ret = futex_wait_until(&ring_buf->data_seq, seq, (0 < timeout_ms)? &deadline: NULL);
+        __atomic_sub_fetch(&ring_buf->get_waiters, 1, __ATOMIC_SEQ_CST);
+        if (ret)
+            return 0;
+    }
+}
+
+unsigned int rbuf_put_timed(ring_buffer_t *ring_buf, const void *data, unsigned int count, int timeout_ms)
+{
+    struct timespec deadline;
+    unsigned int seq;
+    unsigned int n;
+    int ret;
+
+
+    if ((NULL == ring_buf) || (NULL == data) || (0 >= count) || (ring_buf->member_count <= count))
+        return 0;
+
+    if (0 < timeout_ms)
+        get_deadline(&deadline, timeout_ms);
+    for (;;)
+    {
+        __atomic_add_fetch(&ring_buf->put_waiters, 1, __ATOMIC_SEQ_CST);
+        seq = __atomic_load_n(&ring_buf->space_seq, __ATOMIC_SEQ_CST);
+        n = rbuf_put(ring_buf, data, count, 1);
+        if (n || (0 == timeout_ms))
+        {
+            __atomic_sub_fetch(&ring_buf->put_waiters, 1, __ATOMIC_SEQ_CST);
+            return n;
+        }
+        ret = futex_wait_until(&ring_buf->space_seq, seq, (0 < timeout_ms)? &deadline: NULL);
+        __atomic_sub_fetch(&ring_buf->put_waiters, 1, __ATOMIC_SEQ_CST);
+        if (ret)
+            return 0;
+    }
+}
+#endif
@@ -2,6 +2,26 @@
 #define _RING_BUFFER_H_
 
 
+/* 统计功能, 关闭时没有额外开销 */
+/* #define RBUF_STATS_ENABLE */
+/* 驻留时间采样的时间源, 返回 unsigned int, 不定义则不采样 */
+/* #define RBUF_STATS_TIMESTAMP()  HAL_GetTick() */
+/* Linux下的阻塞读写(futex), 仅在空->非空, 满->有空间且有等待者时唤醒 */
+/* #define RBUF_WAIT_ENABLE */
+
+typedef struct
+{
+    unsigned int puts;            /* rbuf_put/rbuf_commit 调用次数 */
+    unsigned int gets;            /* rbuf_get/rbuf_skip 返回非0的次数 */
+    unsigned int put_members;     /* 放入的成员数 */
+    unsigned int get_members;     /* 取出的成员数 */
+    unsigned int dropped;         /* 因空间不足丢弃的成员数 */
+    unsigned int high_water;      /* 最大占用成员数 */
+    unsigned int residency_max;   /* 采样的最大驻留时间 */
+    unsigned int residency_sum;
+    unsigned int residency_count;
+}rbuf_stats_t;
+
 typedef struct
 {
     unsigned char *buf;
@@ -11,6 +31,18 @@ typedef struct
     unsigned int head;
     unsigned int cur;
     unsigned int tail;  /* 永远指向空节点 */
+#ifdef RBUF_STATS_ENABLE
+    rbuf_stats_t stats;
+    unsigned int sample_pos;  /* 正在采样的成员位置 */
+    unsigned int sample_ts;
+    unsigned char sampling;
+#endif
+#ifdef RBUF_WAIT_ENABLE
+    unsigned int data_seq;     /* futex */
+    unsigned int space_seq;    /* futex */
+    unsigned int get_waiters;
+    unsigned int put_waiters;
+#endif
 }ring_buffer_t;
 
 #define RBUF_INITIALIZER(_buf, _buf_size, _member_size) \
@@ -19,6 +51,19 @@ typedef struct
 extern int rbuf_init(ring_buffer_t *ring_buf, void *buf, unsigned int buf_size, unsigned int member_size);
 extern unsigned int rbuf_put(ring_buffer_t *ring_buf, const void *data, unsigned int count, unsigned char full_mode);
 extern unsigned int rbuf_get(ring_buffer_t *ring_buf, unsigned char **data, unsigned int count);
+/* 生产者直接在缓冲区内写入: reserve 返回tail处连续可写的数量, 写完后 commit */
+extern unsigned int rbuf_reserve(ring_buffer_t *ring_buf, unsigned char **data, unsigned int count);
+extern unsigned int rbuf_commit(ring_buffer_t *ring_buf, unsigned int count);
+/* 查看所有可读数据(最多两段), 不移动读指针; 用完后 skip */
+extern unsigned int rbuf_peek2(ring_buffer_t *ring_buf, unsigned char **data1, unsigned int *count1, unsigned char **data2, unsigned int *count2);
+extern unsigned int rbuf_skip(ring_buffer_t *ring_buf, unsigned int count);
+/* 未开启 RBUF_STATS_ENABLE 时返回-1 */
+extern int rbuf_get_stats(ring_buffer_t *ring_buf, rbuf_stats_t *stats, unsigned char reset);
+#ifdef RBUF_WAIT_ENABLE
+/* timeout_ms: 0 不等待, <0 一直等待; put 只支持整体放入(full_mode) */
+extern unsigned int rbuf_get_timed(ring_buffer_t *ring_buf, unsigned char **data, unsigned int count, int timeout_ms);
+extern unsigned int rbuf_put_timed(ring_buffer_t *ring_buf, const void *data, unsigned int count, int timeout_ms);
+#endif
 
 
 #endif
@@ -0,0 +1,99 @@
+#ifndef _RING_BUFFER_POW2_H_
+#define _RING_BUFFER_POW2_H_
+
+#include <string.h>
+
+
+/*
+ * 定长成员的环形缓冲区, 成员数必须是2的幂
+ * head/cur/tail 为自由增长的索引, 通过mask取模, 所有节点都可用
+ * get 的语义与 rbuf_get 相同: 本次取出的数据在下一次 get 之前有效
+ */
+#define RBUF_POW2_INITIALIZER(_buf, _member_count) \
+    {.buf=(_buf),.mask=(_member_count)-1,.head=0,.cur=0,.tail=0}
+
+#define RBUF_POW2_DEFINE(_name, _type) \
+typedef struct \
+{ \
+    _type *buf; \
+    unsigned int mask; \
+    unsigned int head; \
+    unsigned int cur; \
+    unsigned int tail; \
+}_name##_t; \
+\
+static inline int _name##_init(_name##_t *rb, _type *buf, unsigned int member_count) \
+{ \
+    if ((NULL == rb) || (NULL == buf) || (2 > member_count) || (member_count & (member_count - 1))) \
+        return -1; \
+    rb->buf = buf; \
+    rb->mask = member_count - 1; \
+    rb->head = 0; \
+    rb->cur = 0; \
+    rb->tail = 0; \
+    return 0; \
+} \
+\
+static inline unsigned int _name##_put(_name##_t *rb, const _type *data, unsigned int count, unsigned char full_mode) \
+{ \
+    unsigned int tail = rb->tail; \
+    unsigned int max = rb->mask + 1 - (tail - rb->head); \
+    unsigned int off = tail & rb->mask; \
+    unsigned int n1; \
+\
+    if (max < count) \
+    { \
+        if (full_mode) \
+            return 0; \
+        count = max; \
+    } \
+    n1 = rb->mask + 1 - off; \
+    if (count <= n1) \
+    { \
+        memcpy(rb->buf + off, data, count * sizeof(_type)); \
+    } \
+    else \
+    { \
+        memcpy(rb->buf + off, data, n1 * sizeof(_type)); \
+        memcpy(rb->buf, data + n1, (count - n1) * sizeof(_type)); \
+    } \
+    rb->tail = tail + count; \
+    return count; \
+} \
+\
+static inline unsigned int _name##_put1(_name##_t *rb, _type data) \
+{ \
+    unsigned int tail = rb->tail; \
+\
+    if (tail - rb->head > rb->mask) \
+        return 0; \
+    rb->buf[tail & rb->mask] = data; \
+    rb->tail = tail + 1; \
+    return 1; \
+} \
+\
+static inline unsigned int _name##_get(_name##_t *rb, _type **data, unsigned int count) \
+{ \
+    unsigned int cur = rb->cur; \
+    unsigned int max = rb->tail - cur; \
+    unsigned int off = cur & rb->mask; \
+\
+    rb->head = cur; \
+    if (max > rb->mask + 1 - off) \
+        max = rb->mask + 1 - off; \
+    if (max < count) \
+        count = max; \
+    rb->cur = cur + count; \
+    *data = rb->buf + off; \
+    return count; \
+} \
+\
+static inline unsigned int _name##_count(const _name##_t *rb) \
+{ \
+    return rb->tail - rb->cur; \
+}
+
+RBUF_POW2_DEFINE(rbuf8, unsigned char)
+
+
+#endif
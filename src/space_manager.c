@@ -1,4 +1,5 @@
 #include "space_manager.h"
+#include "log.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -14,17 +15,14 @@
 
 
 
-#define LOGLEVEL_ERROR  1
-#define LOGLEVEL_INFO   2
-#define LOGLEVEL_DEBUG  3
 #define LOG(level, fmt, arg...) \
     do { \
-        if (spacem_debug < level) \
+        if (!LOG_ENABLED(level, spacem_debug)) \
             break; \
         if (LOGLEVEL_ERROR == level) \
-            printf("\e[1;31m--SpaceM-- " fmt "\e[0m\n", ##arg); \
+            log_printf("\e[1;31m--SpaceM-- " fmt "\e[0m\n", ##arg); \
         else \
-            printf("--SpaceM-- " fmt "\n", ##arg); \
+            log_printf("--SpaceM-- " fmt "\n", ##arg); \
     } while(0)
 
 #ifndef SPACEM_TASK_MAX
@@ -45,6 +43,7 @@ typedef struct
 
 
 unsigned char spacem_debug = LOGLEVEL_INFO;
+LOG_MODULE_REGISTER("SpaceM", spacem_debug)
 static pthread_mutex_t spacem_mutex = PTHREAD_MUTEX_INITIALIZER;
 static unsigned char spacem_inited = 0;
 static unsigned char should_run = 0;
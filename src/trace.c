@@ -0,0 +1,178 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+#include "trace.h"
+#include <stdio.h>
+#ifdef __linux__
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#else
+#include "stm32u5xx_hal.h"
+#endif
+
+
+
+
+#ifdef __linux__
+typedef unsigned long long trace_ts_t;  /* ns */
+#else
+typedef unsigned int trace_ts_t;        /* CPU周期, 输出时展开回绕 */
+#endif
+
+typedef struct
+{
+    const char *name;
+    trace_ts_t ts;
+#ifdef __linux__
+    int tid;        /* 同一个核上有多个线程, 线程还可能迁移, B/E 按线程配对 */
+#endif
+    char type;
+}trace_event_t;
+
+typedef struct
+{
+    unsigned int head;  /* 只增不减 */
+    trace_event_t events[TRACE_EVENT_COUNT];
+}trace_ring_t;
+
+static trace_ring_t trace_ring_list[TRACE_CORE_MAX];
+static unsigned char trace_running = 0;
+#ifdef __linux__
+static __thread int trace_tid = 0;
+#endif
+
+
+
+
+static inline trace_ts_t trace_ts(void)
+{
+#ifdef __linux__
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (trace_ts_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+    return DWT->CYCCNT;
+#endif
+}
+
+static inline unsigned int trace_core(void)
+{
+#ifdef __linux__
+    int cpu = sched_getcpu();
+
+    return (0 > cpu) ? 0 : ((unsigned int)cpu % TRACE_CORE_MAX);
+#else
+    return 0;
+#endif
+}
+
+int trace_init(void)
+{
+#ifndef __linux__
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+    __atomic_store_n(&trace_running, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void trace_event(const char *name, char type)
+{
+    trace_ring_t *ring;
+    trace_event_t *event;
+    trace_ts_t ts;
+    unsigned int pos;
+
+    if (0 == __atomic_load_n(&trace_running, __ATOMIC_RELAXED))
+        return;
+
+    /*
+     * 同一个核上可能被中断或抢占, 原子地占一个位置
+     * 先取时间戳, 嵌套的中断的事件落在外层的 B/E 之间, 但相邻事件的时间仍可能倒序
+     */
+    ts = trace_ts();
+    ring = &trace_ring_list[trace_core()];
+    pos = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+    event = &ring->events[pos & (TRACE_EVENT_COUNT - 1)];
+    event->name = name;
+    event->type = type;
+    event->ts = ts;
+#ifdef __linux__
+    if (0 == trace_tid)
+        trace_tid = gettid();
+    event->tid = trace_tid;
+#endif
+}
+
+void trace_dump(trace_output_t output)
+{
+    char buf[160];
+    trace_ring_t *ring;
+    trace_event_t *event;
+    unsigned long long us;
+#ifndef __linux__
+    long long cycles = 0;
+    trace_ts_t last = 0;
+    unsigned int started;
+    unsigned int mhz = SystemCoreClock / 1000000;
+#endif
+    unsigned int first = 1;
+    unsigned int start;
+    unsigned int head;
+    unsigned int core;
+    unsigned int i;
+    int len;
+
+    if (NULL == output)
+        return;
+    __atomic_store_n(&trace_running, 0, __ATOMIC_RELEASE);
+
+    output("{\"traceEvents\":[\n", sizeof("{\"traceEvents\":[\n") - 1);
+    for (core = 0; core < TRACE_CORE_MAX; core++)
+    {
+        ring = &trace_ring_list[core];
+        head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        start = (TRACE_EVENT_COUNT < head) ? (head - TRACE_EVENT_COUNT) : 0;
+#ifndef __linux__
+        started = 0;
+#endif
+        for (i = start; i != head; i++)
+        {
+            event = &ring->events[i & (TRACE_EVENT_COUNT - 1)];
+            if (NULL == event->name)
+                continue;
+#ifdef __linux__
+            us = event->ts / 1000;
+#else
+            /* 32位周期计数会回绕, 按相邻事件的差值累加, 被中断打断时差值可能为负 */
+            if (started)
+                cycles += (int)(event->ts - last);
+            else
+                cycles = event->ts;
+            started = 1;
+            last = event->ts;
+            us = (0 < cycles) ? ((unsigned long long)cycles / mhz) : 0;
+#endif
+#ifdef __linux__
+            len = snprintf(buf, sizeof(buf), "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu,\"pid\":0,\"tid\":%d}\n",
+                           first ? "" : ",", event->name, event->type, us, event->tid);
+#else
+            len = snprintf(buf, sizeof(buf), "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu,\"pid\":0,\"tid\":%u}\n",
+                           first ? "" : ",", event->name, event->type, us, core);
+#endif
+            if ((0 > len) || (sizeof(buf) <= (unsigned int)len))
+                continue;
+            output(buf, len);
+            first = 0;
+        }
+        ring->head = 0;
+        for (i = 0; i < TRACE_EVENT_COUNT; i++)
+            ring->events[i].name = NULL;
+    }
+    output("]}\n", sizeof("]}\n") - 1);
+
+    __atomic_store_n(&trace_running, 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,38 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+
+/*
+ * 耗时追踪, 在函数入口和出口记录时间戳到每个核一个的环形缓冲区, 满了覆盖最旧的
+ * 时间戳: Cortex-M 用 DWT CYCCNT, Linux 用 clock_gettime(CLOCK_MONOTONIC_RAW)
+ * trace_dump 输出 Chrome trace JSON, Linux 上 tid 为线程号, MCU 上为核号, 主机上截取 {"traceEvents": 到 ]} 之间的内容
+ * 保存为文件, 用 chrome://tracing 或 Perfetto 打开
+ */
+/* #define TRACE_ENABLE */
+
+#ifndef TRACE_EVENT_COUNT
+#define TRACE_EVENT_COUNT  512  /* 每个核的事件数, 必须是2的幂 */
+#endif
+#ifndef TRACE_CORE_MAX
+#define TRACE_CORE_MAX     4
+#endif
+
+#ifdef TRACE_ENABLE
+/* name 必须是常量字符串, 只保存地址 */
+#define TRACE_BEGIN(name)  trace_event(name, 'B')
+#define TRACE_END(name)    trace_event(name, 'E')
+#else
+#define TRACE_BEGIN(name)  do{}while(0)
+#define TRACE_END(name)    do{}while(0)
+#endif
+
+/* 输出函数, 数据量较大, MCU上应使用阻塞发送 */
+typedef void (*trace_output_t)(const char *str, unsigned int len);
+
+extern int trace_init(void);
+extern void trace_event(const char *name, char type);
+/* 输出后清空 */
+extern void trace_dump(trace_output_t output);
+
+
+#endif
@@ -0,0 +1,686 @@
+/*
+ * emsg 收发的随机对比测试, 参考实现在本文件中:
+ *   转义协议: 逐字节的状态机解码(查表解码 emsg_escape_dfa 之前的实现), 逐字节转义编码
+ *   COBS 协议: 按分隔符切分后整帧解码, 标准 COBS 编码
+ * 随机生成正常帧, 噪声和损坏的帧, 随机切分后交给 emsg_recv, 比较收到的回调和转发发出的字节,
+ * 随机调用 emsg_send_prio, 比较发出的字节
+ * 每种配置(协议 x sender/sendv/发送队列)在单独的子进程中运行, 解码状态互不影响
+ *
+ * gcc -O2 -Wall -pthread -I../src -I../src/emsg emsg_fuzz_test.c ../src/emsg/emsg.c ../src/crc.c \
+ *     ../src/record_ring.c ../src/log_posix.c ../src/log_module.c ../src/mpmc_ring.c -o emsg_fuzz_test
+ * ./emsg_fuzz_test [轮数]      通过时返回0
+ */
+#include "emsg.h"
+#include "emsg_user.h"
+#include "msg_define.h"
+#include "crc.h"
+#include "log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+
+
+
+#define LOCAL_ADDR   DEVICE_ADDR_A  /* emsg_config.h 中的本机地址 */
+#define PEER_ADDR    DEVICE_ADDR_B  /* 唯一的连接的对端, 发往它的帧从这个连接转发回去 */
+#define OTHER_ADDR   3              /* 没有路由 */
+#define MSG_ID_COUNT 3              /* 注册了回调的 msg_id, 再加一个没有注册的 */
+#define STREAM_MAX   30000
+#define CAP_MAX      (1 << 20)
+
+#define MODE_SENDER  0
+#define MODE_SENDV   1
+#define MODE_QUEUE   2
+
+#define CHECK(cond) \
+    do{if (!(cond)){printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); exit(1);}}while(0)
+
+typedef struct
+{
+    unsigned char data[CAP_MAX];
+    unsigned int len;
+}capture_t;
+
+/* 参考实现的转义解码状态 */
+typedef struct
+{
+    uint32_t decoded_len;
+    uint32_t msg_len;
+    uint8_t escape_state;
+    uint8_t buf[EMSG_MSG_LEN_MAX];
+}ref_escape_t;
+
+extern emsg_conn_cfg_t emsg_conn_cfg_list[];
+extern uint8_t emsg_log_level;
+
+/* emsg_config.h 中的连接用到的 */
+uint8_t uart3_conn_id;
+uint32_t uart3_tx_queue[UART3_TX_QUEUE_SIZE / 4];
+
+static uint32_t big_tx_queue[64 * 1024];  /* 一次接收转发的帧都能放下, 处理完再全部发完 */
+static capture_t emsg_cb_cap;
+static capture_t emsg_tx_cap;
+static capture_t ref_cb_cap;
+static capture_t ref_tx_cap;
+static uint8_t protocol;
+static unsigned int tx_pending = 0;  /* 发送队列模式下已交给 sender 还没完成的帧数 */
+static unsigned long long rand_state = 88172645463325252ULL;
+
+
+
+
+static unsigned int rnd(void)
+{
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 7;
+    rand_state ^= rand_state << 17;
+    return (unsigned int)rand_state;
+}
+
+/* 多出现特殊字节, 覆盖转义和 COBS 的边界 */
+static uint8_t rnd_byte(void)
+{
+    switch (rnd() % 10)
+    {
+    case 0: return 0xaa;
+    case 1: return 0x55;
+    case 2: return 0xa5;
+    case 3: return 0x00;
+    default: return rnd();
+    }
+}
+
+static void cap_write(capture_t *cap, const void *data, unsigned int len)
+{
+    CHECK(CAP_MAX - cap->len >= len);
+    if (len)
+        memcpy(cap->data + cap->len, data, len);
+    cap->len += len;
+}
+
+static void cap_check(void)
+{
+    CHECK(ref_cb_cap.len == emsg_cb_cap.len);
+    CHECK(0 == memcmp(ref_cb_cap.data, emsg_cb_cap.data, ref_cb_cap.len));
+    CHECK(ref_tx_cap.len == emsg_tx_cap.len);
+    CHECK(0 == memcmp(ref_tx_cap.data, emsg_tx_cap.data, ref_tx_cap.len));
+    emsg_cb_cap.len = 0;
+    emsg_tx_cap.len = 0;
+    ref_cb_cap.len = 0;
+    ref_tx_cap.len = 0;
+}
+
+static void cb_log(capture_t *cap, uint8_t src_addr, uint16_t msg_id, const void *data, uint16_t len)
+{
+    uint8_t rec[6] = {'C', src_addr, msg_id >> 8, msg_id & 0xff, len >> 8, len & 0xff};
+
+    cap_write(cap, rec, sizeof(rec));
+    cap_write(cap, data, len);
+}
+
+static void msg_cb(uint8_t src_addr, uint16_t msg_id, const void *data, uint16_t len)
+{
+    CHECK((0 == len) || (NULL != data));
+    cb_log(&emsg_cb_cap, src_addr, msg_id, data, len);
+}
+
+uint32_t uart3_sender(const uint8_t *data, uint32_t len)
+{
+    cap_write(&emsg_tx_cap, data, len);
+    if (emsg_conn_cfg_list[0].tx_queue)
+        tx_pending++;
+    return len;
+}
+
+static uint32_t test_sendv(const emsg_iovec_t *iov, uint32_t iovcnt)
+{
+    uint32_t total = 0;
+    uint32_t i;
+
+    CHECK(0 < iovcnt);
+    for (i = 0; i < iovcnt; i++)
+    {
+        cap_write(&emsg_tx_cap, iov[i].data, iov[i].len);
+        total += iov[i].len;
+    }
+    return total;
+}
+
+/* 模拟发送完成中断, 直到队列发完 */
+static void tx_drain(void)
+{
+    while (tx_pending)
+    {
+        tx_pending--;
+        emsg_tx_done(uart3_conn_id);
+    }
+    if (emsg_conn_cfg_list[0].tx_queue)
+    {
+        CHECK(0 == emsg_tx_depth(PEER_ADDR, EMSG_PRIO_CONTROL));
+        CHECK(0 == emsg_tx_depth(PEER_ADDR, EMSG_PRIO_BULK));
+    }
+}
+
+
+/* ---------------- 参考实现 ---------------- */
+
+static uint32_t ref_escape_encode(uint8_t *state, const uint8_t *src, uint32_t len, uint8_t *dst)
+{
+    uint8_t _state = *state;
+    uint8_t *_dst = dst;
+    uint8_t data;
+
+    while (len--)
+    {
+        data = *src++;
+        if (0xaa == data)
+        {
+            _state = 1;
+        }
+        else if (1 == _state)
+        {
+            if (0x55 == data)
+            {
+                *_dst++ = 0xa5;
+                _state = 0;
+            }
+            else if (0xa5 == data)
+            {
+                *_dst++ = 0xa5;
+                _state = 2;
+            }
+            else
+            {
+                _state = 0;
+            }
+        }
+        else if (2 == _state)
+        {
+            if (0xa5 == data)
+                *_dst++ = 0xa5;
+            else
+                _state = 0;
+        }
+        *_dst++ = data;
+    }
+    *state = _state;
+    return _dst - dst;
+}
+
+/* 和 emsg 的编码器一样, 数据正好以254字节的块结束时再输出一个空块 */
+static uint32_t ref_cobs_encode(const uint8_t *src, uint32_t len, uint8_t *dst)
+{
+    uint8_t *_dst = dst;
+    uint32_t i = 0;
+    uint32_t n;
+
+    for (;;)
+    {
+        for (n = 0; (254 > n) && (i + n < len) && src[i + n]; n++)
+            ;
+        *_dst++ = n + 1;
+        memcpy(_dst, src + i, n);
+        _dst += n;
+        i += n;
+        if ((254 > n) && (i < len))
+        {
+            i++;
+            continue;
+        }
+        if (254 == n)
+            continue;
+        break;
+    }
+    *_dst++ = 0;
+    return _dst - dst;
+}
+
+/* frame 为带 sof 的完整帧, 按连接的协议编码 */
+static uint32_t ref_encode(const uint8_t *frame, uint32_t len, uint8_t *dst)
+{
+    uint8_t state = 0;
+
+    if (EMSG_PROTOCOL_COBS == protocol)
+        return ref_cobs_encode(frame + 2, len - 2, dst);
+    dst[0] = 0xaa;
+    dst[1] = 0x55;
+    return 2 + ref_escape_encode(&state, frame + 2, len - 2, dst + 2);
+}
+
+static uint32_t make_frame(uint8_t *frame, uint8_t src, uint8_t dst, uint16_t msg_id, const uint8_t *payload, uint16_t len)
+{
+    uint32_t crc;
+
+    frame[0] = 0xaa;
+    frame[1] = 0x55;
+    frame[2] = src;
+    frame[3] = dst;
+    frame[4] = msg_id >> 8;
+    frame[5] = msg_id & 0xff;
+    frame[6] = len >> 8;
+    frame[7] = len & 0xff;
+    memcpy(frame + 8, payload, len);
+    crc = crc32_cksum(NULL, frame, 8 + len);
+    frame[8 + len] = crc >> 24;
+    frame[9 + len] = (crc >> 16) & 0xff;
+    frame[10 + len] = (crc >> 8) & 0xff;
+    frame[11 + len] = crc & 0xff;
+    return 12 + len;
+}
+
+/* 收到一条完整的消息, 出错返回-1 */
+static int ref_frame(uint8_t *frame, uint32_t len)
+{
+    uint8_t out[EMSG_COBS_LEN_MAX + EMSG_ENCODE_LEN_MAX];
+    uint16_t msg_id;
+    uint32_t crc;
+
+    frame[0] = 0xaa;
+    frame[1] = 0x55;
+    crc = crc32_cksum(NULL, frame, len - 4);
+    if (   (frame[len - 4] != (crc >> 24)) || (frame[len - 3] != ((crc >> 16) & 0xff))
+        || (frame[len - 2] != ((crc >> 8) & 0xff)) || (frame[len - 1] != (crc & 0xff)))
+        return -1;
+    if (EMSG_DEVICE_ADDR_LOCAL == frame[2])
+        return -1;
+
+    msg_id = (frame[4] << 8) | frame[5];
+    if (LOCAL_ADDR == frame[3])
+    {
+        if (MSG_ID_COUNT > msg_id)
+            cb_log(&ref_cb_cap, frame[2], msg_id, frame + 8, len - 12);
+    }
+    else if (PEER_ADDR == frame[3])
+    {
+        /* 原样转发, 帧头和 crc 不变 */
+        cap_write(&ref_tx_cap, out, ref_encode(frame, len, out));
+    }
+    return 0;
+}
+
+static void ref_escape_recv(ref_escape_t *d, const uint8_t *data, uint32_t len)
+{
+    uint16_t payload_len;
+    uint8_t c;
+
+    while (len--)
+    {
+        c = *data++;
+        if (2 > d->decoded_len)
+        {
+            if (0 == d->decoded_len)
+            {
+                if (0xaa == c)
+                    d->decoded_len = 1;
+            }
+            else if (0x55 == c)
+            {
+                d->decoded_len = 2;
+                d->escape_state = 0;
+                d->msg_len = 0;
+            }
+            else
+            {
+                d->decoded_len = 0;
+            }
+            continue;
+        }
+
+        if (0 == d->escape_state)
+        {
+            if (0xaa == c)
+                d->escape_state = 1;
+        }
+        else if (1 == d->escape_state)
+        {
+            if (0xa5 == c)
+            {
+                d->escape_state = 2;
+            }
+            else if (0x55 == c)
+            {
+                /* 未转义的 aa 55, 新的一帧 */
+                d->decoded_len = 2;
+                d->escape_state = 0;
+                d->msg_len = 0;
+                continue;
+            }
+            else if (0xaa != c)
+            {
+                d->escape_state = 0;
+            }
+        }
+        else if (2 == d->escape_state)
+        {
+            if (0xa5 == c)
+            {
+                d->escape_state = 3;
+                d->decoded_len--;
+            }
+            else if (0x55 == c)
+            {
+                d->escape_state = 0;
+                d->decoded_len--;
+            }
+            else
+            {
+                d->decoded_len = (0xaa == c) ? 1 : 0;
+                continue;
+            }
+        }
+        else if (3 == d->escape_state)
+        {
+            if (0xa5 == c)
+                d->escape_state = 4;
+            else if (0xaa == c)
+                d->escape_state = 1;
+            else
+                d->escape_state = 0;
+        }
+        else
+        {
+            if (0xa5 == c)
+            {
+                d->escape_state = 3;
+                d->decoded_len--;
+            }
+            else
+            {
+                d->decoded_len = (0xaa == c) ? 1 : 0;
+                continue;
+            }
+        }
+
+        d->buf[d->decoded_len++] = c;
+        if (0 == d->msg_len)
+        {
+            if (   ((8 <= d->decoded_len) && (2 != d->escape_state) && (4 != d->escape_state))
+                || (8 < d->decoded_len))
+            {
+                payload_len = (d->buf[6] << 8) | d->buf[7];
+                if (EMSG_PAYLOAD_LEN_MAX < payload_len)
+                {
+                    d->decoded_len = (0xaa == d->buf[d->decoded_len - 1]) ? 1 : 0;
+                    continue;
+                }
+                d->msg_len = 8 + payload_len + 4;
+            }
+        }
+        if ((0 == d->msg_len) || (d->msg_len > d->decoded_len) || (2 == d->escape_state) || (4 == d->escape_state))
+            continue;
+
+        if (ref_frame(d->buf, d->msg_len))
+            d->decoded_len = (0xaa == d->buf[d->decoded_len - 1]) ? 1 : 0;
+        else
+            d->decoded_len = 0;
+    }
+}
+
+/* 分隔符之间的一段, 整段按 COBS 解码 */
+static void ref_cobs_frame(const uint8_t *src, uint32_t len)
+{
+    uint8_t frame[EMSG_MSG_LEN_MAX + 256];
+    uint32_t n = 2;
+    uint32_t i = 0;
+    uint16_t payload_len;
+    uint8_t code;
+
+    if (0 == len)
+        return;
+    while (i < len)
+    {
+        code = src[i++];
+        if (len - i < (uint32_t)(code - 1))
+            return;
+        memcpy(frame + n, src + i, code - 1);
+        n += code - 1;
+        i += code - 1;
+        if ((0xff != code) && (i < len))
+            frame[n++] = 0;
+        if (EMSG_MSG_LEN_MAX < n)
+            return;
+    }
+    if (12 > n)
+        return;
+    payload_len = (frame[6] << 8) | frame[7];
+    if ((EMSG_PAYLOAD_LEN_MAX < payload_len) || (12u + payload_len != n))
+        return;
+    ref_frame(frame, n);
+}
+
+/* 上电后的第一帧前面可能没有分隔符, 从流的开头就开始一帧 */
+static void ref_cobs_recv(const uint8_t *stream, uint32_t len)
+{
+    static uint8_t pending[STREAM_MAX * 2];
+    static uint32_t pending_len = 0;
+    uint32_t i;
+
+    for (i = 0; i < len; i++)
+    {
+        if (stream[i])
+        {
+            CHECK(sizeof(pending) > pending_len);
+            pending[pending_len++] = stream[i];
+            continue;
+        }
+        ref_cobs_frame(pending, pending_len);
+        pending_len = 0;
+    }
+}
+
+
+/* ---------------- 测试 ---------------- */
+
+/* 随机的一帧, 编码后写入 out, 可能是长度错误或有一位翻转 */
+static uint32_t rnd_encoded_frame(uint8_t *out)
+{
+    static const uint8_t addrs[] = {LOCAL_ADDR, LOCAL_ADDR, PEER_ADDR, OTHER_ADDR, EMSG_DEVICE_ADDR_LOCAL};
+    uint8_t frame[EMSG_MSG_LEN_MAX + 16];
+    uint8_t payload[EMSG_PAYLOAD_LEN_MAX];
+    uint16_t len;
+    uint16_t i;
+    uint32_t n;
+    uint8_t dense = rnd() & 1;
+
+    len = rnd() % ((rnd() % 4) ? 40 : (EMSG_PAYLOAD_LEN_MAX + 1));
+    for (i = 0; i < len; i++)
+        payload[i] = dense ? rnd_byte() : rnd();
+    n = make_frame(frame, (rnd() % 8) ? PEER_ADDR : EMSG_DEVICE_ADDR_LOCAL, addrs[rnd() % sizeof(addrs)],
+                   rnd() % (MSG_ID_COUNT + 1), payload, len);
+    /* 长度字段超过最大值 */
+    if (0 == rnd() % 30)
+    {
+        frame[6] = 0x01 + rnd() % 0xff;
+        frame[7] = rnd();
+    }
+    n = ref_encode(frame, n, out);
+    if (0 == rnd() % 8)
+        out[rnd() % n] ^= 1 << (rnd() % 8);
+    return n;
+}
+
+static void test_recv(ref_escape_t *ref, unsigned int rounds)
+{
+    static uint8_t stream[STREAM_MAX + EMSG_COBS_LEN_MAX + EMSG_ENCODE_LEN_MAX];
+    unsigned int round;
+    uint32_t len;
+    uint32_t pos;
+    uint32_t n;
+    uint32_t i;
+
+    for (round = 0; round < rounds; round++)
+    {
+        for (len = 0; STREAM_MAX > len; )
+        {
+            if (rnd() % 5)
+            {
+                len += rnd_encoded_frame(stream + len);
+            }
+            else
+            {
+                for (n = rnd() % 20, i = 0; i < n; i++)
+                    stream[len++] = rnd_byte();
+            }
+        }
+
+        /* 随机切分, 有逐字节的, 也有跨越多帧的 */
+        for (pos = 0; pos < len; pos += n)
+        {
+            n = 1 + rnd() % ((rnd() % 2) ? 8 : 700);
+            if (len - pos < n)
+                n = len - pos;
+            if (EMSG_PROTOCOL_COBS == protocol)
+                ref_cobs_recv(stream + pos, n);
+            else
+                ref_escape_recv(ref, stream + pos, n);
+            CHECK(0 == emsg_recv(uart3_conn_id, stream + pos, n));
+            tx_drain();
+            cap_check();
+        }
+    }
+}
+
+static void test_send(unsigned int rounds)
+{
+    uint8_t frame[EMSG_MSG_LEN_MAX + 16];
+    uint8_t out[EMSG_COBS_LEN_MAX + EMSG_ENCODE_LEN_MAX];
+    uint8_t payload[EMSG_PAYLOAD_LEN_MAX];
+    unsigned int round;
+    uint16_t msg_id;
+    uint16_t len;
+    uint16_t i;
+    uint8_t prio;
+    uint8_t dense;
+
+    for (round = 0; round < rounds; round++)
+    {
+        dense = rnd() & 1;
+        len = rnd() % ((rnd() % 4) ? 40 : (EMSG_PAYLOAD_LEN_MAX + 1));
+        for (i = 0; i < len; i++)
+            payload[i] = dense ? rnd_byte() : rnd();
+        msg_id = rnd() % (MSG_ID_COUNT + 1);
+        prio = rnd() % EMSG_PRIO_COUNT;
+
+        if (0 == rnd() % 8)
+        {
+            /* 发给本机的直接调用回调, src 为 EMSG_DEVICE_ADDR_LOCAL */
+            CHECK(0 == emsg_send_prio(LOCAL_ADDR, msg_id, payload, len, prio));
+            if (MSG_ID_COUNT > msg_id)
+                cb_log(&ref_cb_cap, EMSG_DEVICE_ADDR_LOCAL, msg_id, payload, len);
+        }
+        else
+        {
+            CHECK(0 == emsg_send_prio(PEER_ADDR, msg_id, payload, len, prio));
+            cap_write(&ref_tx_cap, out, ref_encode(frame, make_frame(frame, LOCAL_ADDR, PEER_ADDR, msg_id, payload, len), out));
+        }
+        tx_drain();
+        cap_check();
+    }
+
+    CHECK(-1 == emsg_send(PEER_ADDR, 0, payload, EMSG_PAYLOAD_LEN_MAX + 1));
+    CHECK(-1 == emsg_send(OTHER_ADDR, 0, payload, 1));
+    cap_check();
+}
+
+/* 正在发送时放入的帧, 控制帧先于之前放入的批量帧发出 */
+static void test_queue_prio(void)
+{
+    uint8_t frame[EMSG_MSG_LEN_MAX + 16];
+    uint8_t out[EMSG_COBS_LEN_MAX + EMSG_ENCODE_LEN_MAX];
+    static const uint8_t order[] = {10, 13, 11, 12};
+    uint8_t data = 1;
+    unsigned int i;
+
+    CHECK(0 == emsg_send_prio(PEER_ADDR, 10, &data, 1, EMSG_PRIO_BULK));
+    CHECK(0 == emsg_send_prio(PEER_ADDR, 11, &data, 1, EMSG_PRIO_BULK));
+    CHECK(0 == emsg_send_prio(PEER_ADDR, 12, &data, 1, EMSG_PRIO_BULK));
+    CHECK(0 == emsg_send_prio(PEER_ADDR, 13, &data, 1, EMSG_PRIO_CONTROL));
+    CHECK(1 == emsg_tx_depth(PEER_ADDR, EMSG_PRIO_CONTROL));
+    CHECK(3 == emsg_tx_depth(PEER_ADDR, EMSG_PRIO_BULK));
+    tx_drain();
+    for (i = 0; i < sizeof(order); i++)
+        cap_write(&ref_tx_cap, out, ref_encode(frame, make_frame(frame, LOCAL_ADDR, PEER_ADDR, order[i], &data, 1), out));
+    cap_check();
+
+    /* 队列满时 emsg_tx_ready 返回0, emsg_send 返回-1, 另一个优先级不受影响 */
+    emsg_tx_cap.len = 0;
+    for (i = 0; emsg_tx_ready(PEER_ADDR, EMSG_PRIO_BULK, EMSG_PAYLOAD_LEN_MAX); i++)
+        CHECK(0 == emsg_send_prio(PEER_ADDR, 1, frame, EMSG_PAYLOAD_LEN_MAX, EMSG_PRIO_BULK));
+    CHECK(0 < i);
+    CHECK(-1 == emsg_send_prio(PEER_ADDR, 1, frame, EMSG_PAYLOAD_LEN_MAX, EMSG_PRIO_BULK));
+    CHECK(emsg_tx_ready(PEER_ADDR, EMSG_PRIO_CONTROL, EMSG_PAYLOAD_LEN_MAX));
+    tx_drain();
+    CHECK(emsg_tx_ready(PEER_ADDR, EMSG_PRIO_BULK, EMSG_PAYLOAD_LEN_MAX));
+    emsg_tx_cap.len = 0;
+}
+
+static int run(uint8_t proto, unsigned int mode, unsigned int rounds)
+{
+    ref_escape_t ref;
+    uint16_t id;
+
+    protocol = proto;
+    rand_state += proto * 3 + mode;
+    emsg_log_level = LOGLEVEL_NONE;
+    emsg_conn_cfg_list[0].protocol = proto;
+    emsg_conn_cfg_list[0].sendv = (MODE_SENDV == mode) ? test_sendv : NULL;
+    if (MODE_QUEUE == mode)
+    {
+        emsg_conn_cfg_list[0].tx_queue = big_tx_queue;
+        emsg_conn_cfg_list[0].tx_queue_size = sizeof(big_tx_queue);
+    }
+    else
+    {
+        emsg_conn_cfg_list[0].tx_queue = NULL;
+        emsg_conn_cfg_list[0].tx_queue_size = 0;
+    }
+    CHECK(0 == emsg_init());
+    for (id = 0; id < MSG_ID_COUNT; id++)
+        CHECK(0 == emsg_register_cb(id, msg_cb, 0));
+
+    memset(&ref, 0, sizeof(ref));
+    test_recv(&ref, rounds);
+    test_send(rounds * 100);
+    if (MODE_QUEUE == mode)
+    {
+        test_queue_prio();
+        /* 小队列 */
+        emsg_conn_cfg_list[0].tx_queue = uart3_tx_queue;
+        emsg_conn_cfg_list[0].tx_queue_size = sizeof(uart3_tx_queue);
+        CHECK(0 == emsg_init());
+        test_queue_prio();
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    static const char *mode_names[] = {"sender", "sendv", "queue"};
+    unsigned int rounds = (1 < argc) ? strtoul(argv[1], NULL, 0) : 20;
+    unsigned int proto;
+    unsigned int mode;
+    pid_t pid;
+    int status;
+    int ret = 0;
+
+    for (proto = EMSG_PROTOCOL_ESCAPE; proto <= EMSG_PROTOCOL_COBS; proto++)
+    {
+        for (mode = MODE_SENDER; mode <= MODE_QUEUE; mode++)
+        {
+            fflush(stdout);
+            pid = fork();
+            CHECK(0 <= pid);
+            if (0 == pid)
+                exit(run(proto, mode, rounds));
+            CHECK(pid == waitpid(pid, &status, 0));
+            printf("%s %-6s : %s\n", (EMSG_PROTOCOL_COBS == proto) ? "cobs  " : "escape", mode_names[mode],
+                   (WIFEXITED(status) && (0 == WEXITSTATUS(status))) ? "ok" : "FAIL");
+            if (!WIFEXITED(status) || WEXITSTATUS(status))
+                ret = 1;
+        }
+    }
+    return ret;
+}
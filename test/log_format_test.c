@@ -0,0 +1,266 @@
+/*
+ * log_format_lite 的正确性测试(与 snprintf 对比输出和返回值), 以及与 vsnprintf 的耗时对比
+ *
+ * 主机:
+ * gcc -O2 -Wall -I../src log_format_test.c ../src/log_format.c -o log_format_test
+ * ./log_format_test          正确性测试, 通过时返回0
+ * ./log_format_test bench    几种日志行格式化一次的耗时, 单位 ns/行和周期/行(rdtsc, 只在 x86 上有)
+ *
+ * Cortex-M: 本文件和 log_format.c 加入工程, log_init 之后调用 log_format_bench(),
+ * 关中断用 DWT 周期计数器测量, 结果通过 log_printf 输出, 单位 周期/行
+ */
+#include "log.h"
+#include "log_format.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#ifdef __linux__
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#else
+#include "stm32u5xx_hal.h"
+#endif
+
+
+
+
+#ifdef __linux__
+#define TEST_COUNT   2000000
+#define BENCH_LOOPS  1000000
+#else
+#define BENCH_LOOPS  1000
+#endif
+
+#define CHECK(cond) \
+    do{if (!(cond)){printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); exit(1);}}while(0)
+
+/* 一种日志行, lite 为1时用 log_format_lite, 否则用 vsnprintf */
+typedef int (*bench_line_t)(char lite, char *out, unsigned int size, unsigned int i);
+
+typedef struct
+{
+    const char *name;
+    bench_line_t line;
+}bench_case_t;
+
+
+
+
+static int format(char lite, char *out, unsigned int size, const char *fmt, ...)
+{
+    va_list arg;
+    int len;
+
+    va_start(arg, fmt);
+    if (lite)
+        len = log_format_lite(out, size, fmt, arg);
+    else
+        len = vsnprintf(out, size, fmt, arg);
+    va_end(arg);
+    return len;
+}
+
+static int line_emsg(char lite, char *out, unsigned int size, unsigned int i)
+{
+    return format(lite, out, size, "--EMSG-- conn(%u) recv msg(%zu): id %02x crc %06x t=%llu %s\n",
+                  i & 3, (size_t)i * 3, i & 0xff, i * 7, (unsigned long long)i * 1000003, "ok");
+}
+
+static int line_err(char lite, char *out, unsigned int size, unsigned int i)
+{
+    return format(lite, out, size, "--EMSG-- send to %u failed, ret %d\n", i & 0xff, -(int)(i & 0x7f));
+}
+
+static int line_dec(char lite, char *out, unsigned int size, unsigned int i)
+{
+    return format(lite, out, size, "adc %5d %5d %5d\n", (int)(i & 0xfff), (int)(i >> 4) - 2048, (int)i);
+}
+
+static int line_hex(char lite, char *out, unsigned int size, unsigned int i)
+{
+    return format(lite, out, size, "reg %08x = %08X\n", i, ~i);
+}
+
+static const bench_case_t bench_cases[] =
+{
+    {"emsg", line_emsg},
+    {"err ", line_err},
+    {"dec ", line_dec},
+    {"hex ", line_hex},
+};
+
+
+#ifdef __linux__
+static unsigned long long rand_state = 88172645463325252ULL;
+
+static unsigned long long rnd(void)
+{
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 7;
+    rand_state ^= rand_state << 17;
+    return rand_state;
+}
+
+/* 输出和返回值都必须和 snprintf 相同, 缓冲区大小随机以覆盖截断 */
+#define CHECK_SAME(fmt, arg...) \
+    do{ \
+        char a[80]; \
+        char b[80]; \
+        unsigned int _size = 1 + rnd() % 48; \
+        CHECK(format(1, a, _size, fmt, ##arg) == snprintf(b, _size, fmt, ##arg)); \
+        CHECK(0 == strcmp(a, b)); \
+    }while(0)
+
+static void test_random(void)
+{
+    unsigned long long v;
+    unsigned int u;
+    unsigned int k;
+    int d;
+
+    for (k = 0; k < TEST_COUNT; k++)
+    {
+        v = rnd() >> (rnd() % 64);
+        u = (unsigned int)v;
+        d = (int)v;
+        CHECK_SAME("%u", u);
+        CHECK_SAME("%d %i", d, -d);
+        CHECK_SAME("x%02x %02X|", u & 0xff, u);
+        CHECK_SAME("%06x", u);
+        CHECK_SAME("%llu", v);
+        CHECK_SAME("%lld", (long long)v);
+        CHECK_SAME("%zu", (size_t)v);
+        CHECK_SAME("%lu %lx", (unsigned long)v, (unsigned long)v);
+        CHECK_SAME("%llx %llX", v, v);
+        CHECK_SAME("%5d|%-5d|%05d", d % 1000, d % 1000, d % 1000);
+        CHECK_SAME("%hu %hd %hhu %hhd", u, d, u, d);
+        CHECK_SAME("%s %c %%", (k & 1) ? "abc" : "", 'A' + k % 26);
+        CHECK_SAME("%-8s|%8s|%-3c|", (k & 1) ? "abc" : "", (k & 2) ? "xyz" : "", 'x');
+    }
+}
+
+static void test_edge(void)
+{
+    char out[64];
+
+    CHECK_SAME("%llu", 18446744073709551615ULL);
+    CHECK_SAME("%llu", 10000000000000000000ULL);
+    CHECK_SAME("%llu", 4294967296ULL);
+    CHECK_SAME("%lld", (long long)0x8000000000000000ULL);
+    CHECK_SAME("%d", (int)0x80000000);
+    CHECK_SAME("%s", "");
+    CHECK_SAME("no args");
+    CHECK_SAME("%020llu|%-20lld|", 12345678901234ULL, -12345678901234LL);
+
+    /* 不支持的格式返回-1, 大小为0也返回-1, 由调用者改用 vsnprintf */
+    CHECK(-1 == format(1, out, sizeof(out), "%f", 1.0));
+    CHECK(-1 == format(1, out, sizeof(out), "%d %.3d", 1, 2));
+    CHECK(-1 == format(1, out, sizeof(out), "%*d", 3, 2));
+    CHECK(-1 == format(1, out, sizeof(out), "%p", out));
+    CHECK(-1 == format(1, out, 0, "abc"));
+}
+
+static double ns_now(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+/* lite 为1和0各测一遍, ns[] 和 cyc[] 按同样的顺序保存每行的平均耗时 */
+static void bench_line(bench_line_t line, double ns[2], double cyc[2])
+{
+    char out[128];
+    volatile int sink = 0;
+    unsigned long long c0 = 0;
+    unsigned long long c1 = 0;
+    double t0;
+    unsigned int i;
+    int lite;
+
+    for (lite = 1; lite >= 0; lite--)
+    {
+        t0 = ns_now();
+#if defined(__x86_64__) || defined(__i386__)
+        c0 = __rdtsc();
+#endif
+        for (i = 0; i < BENCH_LOOPS; i++)
+            sink += line(lite, out, sizeof(out), i);
+#if defined(__x86_64__) || defined(__i386__)
+        c1 = __rdtsc();
+#endif
+        ns[1 - lite] = (ns_now() - t0) / BENCH_LOOPS;
+        cyc[1 - lite] = (double)(c1 - c0) / BENCH_LOOPS;
+    }
+}
+
+static void bench(void)
+{
+    double ns[2];
+    double cyc[2];
+    unsigned int n;
+
+    printf("line  lite ns  vsnprintf ns  lite cyc  vsnprintf cyc\n");
+    for (n = 0; n < sizeof(bench_cases) / sizeof(bench_cases[0]); n++)
+    {
+        bench_line(bench_cases[n].line, ns, cyc);
+        printf("%s %8.1f %13.1f %9.0f %14.0f\n", bench_cases[n].name, ns[0], ns[1], cyc[0], cyc[1]);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if ((1 < argc) && (0 == strcmp(argv[1], "bench")))
+    {
+        bench();
+        return 0;
+    }
+    test_edge();
+    test_random();
+    printf("ok\n");
+    return 0;
+}
+
+#else
+/* 关中断测量 BENCH_LOOPS 次的周期数, 返回每行的平均值 */
+static unsigned int bench_cycles(bench_line_t line, char lite)
+{
+    char out[128];
+    volatile int sink = 0;
+    unsigned int primask;
+    unsigned int start;
+    unsigned int cycles;
+    unsigned int i;
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+    start = DWT->CYCCNT;
+    for (i = 0; i < BENCH_LOOPS; i++)
+        sink += line(lite, out, sizeof(out), i);
+    cycles = DWT->CYCCNT - start;
+    __set_PRIMASK(primask);
+    return cycles / BENCH_LOOPS;
+}
+
+void log_format_bench(void)
+{
+    unsigned int lite;
+    unsigned int libc;
+    unsigned int n;
+
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    for (n = 0; n < sizeof(bench_cases) / sizeof(bench_cases[0]); n++)
+    {
+        lite = bench_cycles(bench_cases[n].line, 1);
+        libc = bench_cycles(bench_cases[n].line, 0);
+        log_printf("log_format %s: lite %u cyc, vsnprintf %u cyc\r\n", bench_cases[n].name, lite, libc);
+    }
+}
+#endif
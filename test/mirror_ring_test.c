@@ -0,0 +1,195 @@
+/*
+ * mirror_ring 的正确性测试: 回绕处的读写是否连续, 索引越过32位时是否正确,
+ * 以及按行分帧的解析器直接在缓冲区上运行(不处理回绕, 不复制)
+ *
+ * gcc -O2 -Wall -pthread -I../src mirror_ring_test.c ../src/mirror_ring.c -o mirror_ring_test
+ * ./mirror_ring_test          通过时返回0
+ */
+#include "mirror_ring.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+
+
+
+#define LINES  200000  /* 多线程测试的行数 */
+
+#define CHECK(cond) \
+    do{if (!(cond)){printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); exit(1);}}while(0)
+
+static mirror_ring_t ring;
+
+
+
+
+static void test_wrap(void)
+{
+    unsigned char in[4096];
+    unsigned char *p;
+    unsigned int size;
+    unsigned int n;
+    unsigned int i;
+
+    CHECK(0 == mring_init(&ring, 1000));
+    size = ring.size;
+    CHECK(4096 <= size);
+    CHECK(0 == (size & (size - 1)));
+
+    /* 两半映射的是同一块内存 */
+    ring.buf[10] = 0x5a;
+    CHECK(0x5a == ring.buf[size + 10]);
+    ring.buf[size + 20] = 0xa5;
+    CHECK(0xa5 == ring.buf[20]);
+
+    /* 读写位置移到接近末尾, 下一次写跨过回绕点 */
+    n = size - 100;
+    CHECK(n == mring_commit(&ring, n));
+    CHECK(n == mring_consume(&ring, n));
+    CHECK(size == mring_write_ptr(&ring, &p));
+    CHECK(ring.buf + n == p);
+
+    for (i = 0; i < sizeof(in); i++)
+        in[i] = (unsigned char)(i * 13);
+    CHECK(1000 == mring_put(&ring, in, 1000, 1));
+    CHECK(1000 == mring_read_ptr(&ring, &p));
+    CHECK(0 == memcmp(p, in, 1000));
+    /* 越过末尾的部分在物理上位于开头 */
+    CHECK(0 == memcmp(ring.buf, in + 100, 900));
+    CHECK(1000 == mring_consume(&ring, 2000));
+    CHECK(0 == mring_read_ptr(&ring, &p));
+
+    /* 满了以后 full_mode 整体丢弃, 否则放入剩余部分 */
+    for (n = 0; n < size; n += 1000)
+        mring_put(&ring, in, (size - n < 1000) ? (size - n) : 1000, 1);
+    CHECK(0 == mring_write_ptr(&ring, &p));
+    CHECK(0 == mring_put(&ring, in, 1, 1));
+    CHECK(0 == mring_commit(&ring, 1));
+    CHECK(10 == mring_consume(&ring, 10));
+    CHECK(0 == mring_put(&ring, in, 11, 1));
+    CHECK(10 == mring_put(&ring, in, 11, 0));
+    CHECK(size == mring_read_ptr(&ring, &p));
+
+    mring_exit(&ring);
+    CHECK(NULL == ring.buf);
+}
+
+/* 读写索引从接近 0xffffffff 开始, 随机大小的读写, 检查数据顺序和数量 */
+static void test_overflow(void)
+{
+    unsigned char in[8192];
+    unsigned char *p;
+    unsigned int rand_state = 1;
+    unsigned int put_seq = 0;
+    unsigned int get_seq = 0;
+    unsigned int crossed = 0;
+    unsigned int count;
+    unsigned int n;
+    unsigned int i;
+    unsigned int k;
+
+    CHECK(0 == mring_init(&ring, 4096));
+    ring.head = 0xffffffff - 3 * ring.size - 7;
+    ring.tail = ring.head;
+
+    for (k = 0; k < 200000; k++)
+    {
+        count = rand_r(&rand_state) % sizeof(in);
+        for (i = 0; i < count; i++)
+            in[i] = (unsigned char)(put_seq + i);
+        n = mring_put(&ring, in, count, k & 1);
+        CHECK(ring.size >= ring.tail - ring.head);
+        put_seq += n;
+
+        n = mring_read_ptr(&ring, &p);
+        CHECK(put_seq - get_seq == n);
+        count = rand_r(&rand_state) % (n + 1);
+        for (i = 0; i < count; i++)
+            CHECK((unsigned char)(get_seq + i) == p[i]);
+        if (ring.head > ring.head + count)
+            crossed++;
+        CHECK(count == mring_consume(&ring, count));
+        get_seq += count;
+    }
+    CHECK(0 < crossed);
+    mring_exit(&ring);
+}
+
+/*
+ * NMEA 风格的行 "$GPTST,<序号>*\r\n", 写线程随机分块写入,
+ * 读线程用 memchr 找行尾, strtoul 直接在缓冲区上解析, 一行处理完才释放
+ */
+static void* writer_thread(void *arg)
+{
+    char text[64];
+    unsigned int rand_state = 2;
+    unsigned int seq = 0;
+    unsigned int len = 0;
+    unsigned int off = 0;
+    unsigned int count;
+    unsigned int n;
+
+    (void)arg;
+    while (seq < LINES)
+    {
+        if (off == len)
+        {
+            len = snprintf(text, sizeof(text), "$GPTST,%u*\r\n", seq++);
+            off = 0;
+        }
+        count = rand_r(&rand_state) % (len - off) + 1;
+        n = mring_put(&ring, text + off, count, 0);
+        if (0 == n)
+            sched_yield();
+        off += n;
+    }
+    while (off < len)
+        off += mring_put(&ring, text + off, len - off, 0);
+    return NULL;
+}
+
+static void test_lines(void)
+{
+    pthread_t tid;
+    unsigned char *p;
+    unsigned char *eol;
+    unsigned int seq = 0;
+    unsigned int n;
+    char *end;
+
+    CHECK(0 == mring_init(&ring, 4096));
+    ring.head = 0xffffffff - 100000;
+    ring.tail = ring.head;
+    CHECK(0 == pthread_create(&tid, NULL, writer_thread, NULL));
+
+    while (seq < LINES)
+    {
+        n = mring_read_ptr(&ring, &p);
+        eol = n ? (unsigned char *)memchr(p, '\n', n) : NULL;
+        if (NULL == eol)
+        {
+            sched_yield();
+            continue;
+        }
+        CHECK(0 == memcmp(p, "$GPTST,", 7));
+        CHECK(seq == strtoul((char *)p + 7, &end, 10));
+        CHECK((unsigned char *)end + 3 == eol + 1);
+        CHECK('*' == *end);
+        mring_consume(&ring, eol + 1 - p);
+        seq++;
+    }
+    pthread_join(tid, NULL);
+    CHECK(0 == mring_read_ptr(&ring, &p));
+    mring_exit(&ring);
+}
+
+int main(void)
+{
+    test_wrap();
+    test_overflow();
+    test_lines();
+    printf("ok\n");
+    return 0;
+}
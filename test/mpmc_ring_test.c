@@ -0,0 +1,276 @@
+/*
+ * mpmc_ring 批量 put/get 的正确性测试, 以及与加锁的 rbuf 的吞吐对比
+ *
+ * gcc -O2 -Wall -pthread -I../src mpmc_ring_test.c ../src/mpmc_ring.c ../src/ring_buffer.c -o mpmc_ring_test
+ * ./mpmc_ring_test          正确性测试, 通过时返回0
+ * ./mpmc_ring_test bench    2~16个线程(一半生产一半消费)的吞吐, 单位 M个/秒
+ */
+#include "mpmc_ring.h"
+#include "ring_buffer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+
+
+
+#define TEST_COUNT     (1 << 10)     /* 队列成员数 */
+#define ITEMS          20000         /* 多线程测试每个生产者放入的数量 */
+#define BATCH_MAX      16
+#define THREAD_MAX     16
+
+#define CHECK(cond) \
+    do{if (!(cond)){printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); exit(1);}}while(0)
+
+typedef struct
+{
+    unsigned int producer;
+    unsigned int seq;
+}item_t;
+
+static mpmc_ring_t ring;
+static unsigned int producer_count;
+static unsigned int items_per_producer;
+static unsigned int batch_size;         /* 0 表示随机 1~BATCH_MAX */
+static unsigned int consumed = 0;
+static unsigned long long consumed_sum = 0;
+
+static pthread_mutex_t rbuf_mutex = PTHREAD_MUTEX_INITIALIZER;
+static ring_buffer_t rbuf;
+static item_t rbuf_mem[TEST_COUNT];
+static unsigned char use_rbuf = 0;
+
+
+
+
+static unsigned int next_batch(unsigned int *rand_state)
+{
+    if (batch_size)
+        return batch_size;
+    return rand_r(rand_state) % BATCH_MAX + 1;
+}
+
+static unsigned int ring_put(const item_t *items, unsigned int count)
+{
+    unsigned int n;
+
+    if (0 == use_rbuf)
+        return mpmc_put(&ring, items, count);
+    pthread_mutex_lock(&rbuf_mutex);
+    n = rbuf_put(&rbuf, items, count, 0);
+    pthread_mutex_unlock(&rbuf_mutex);
+    return n;
+}
+
+static unsigned int ring_get(item_t *items, unsigned int count)
+{
+    unsigned char *p;
+    unsigned int n;
+
+    if (0 == use_rbuf)
+        return mpmc_get(&ring, items, count);
+    pthread_mutex_lock(&rbuf_mutex);
+    n = rbuf_get(&rbuf, &p, count);
+    memcpy(items, p, n * sizeof(item_t));
+    pthread_mutex_unlock(&rbuf_mutex);
+    return n;
+}
+
+static void* producer_thread(void *arg)
+{
+    item_t items[BATCH_MAX];
+    unsigned int id = (unsigned int)(unsigned long)arg;
+    unsigned int rand_state = id + 1;
+    unsigned int seq = 0;
+    unsigned int count;
+    unsigned int n;
+    unsigned int i;
+
+    while (seq < items_per_producer)
+    {
+        count = next_batch(&rand_state);
+        if (items_per_producer - seq < count)
+            count = items_per_producer - seq;
+        for (i = 0; i < count; i++)
+        {
+            items[i].producer = id;
+            items[i].seq = seq + i;
+        }
+        n = ring_put(items, count);
+        if (0 == n)
+            sched_yield();
+        seq += n;
+    }
+    return NULL;
+}
+
+/* 同一个消费者看到的每个生产者的序号必须递增 */
+static void* consumer_thread(void *arg)
+{
+    item_t items[BATCH_MAX];
+    unsigned int last[THREAD_MAX];
+    unsigned int rand_state = (unsigned int)(unsigned long)arg + 100;
+    unsigned int total = producer_count * items_per_producer;
+    unsigned long long sum = 0;
+    unsigned int n;
+    unsigned int i;
+
+    memset(last, 0xff, sizeof(last));
+    while (__atomic_load_n(&consumed, __ATOMIC_RELAXED) < total)
+    {
+        n = ring_get(items, next_batch(&rand_state));
+        for (i = 0; i < n; i++)
+        {
+            CHECK(items[i].producer < producer_count);
+            CHECK(items[i].seq < items_per_producer);
+            CHECK((0xffffffff == last[items[i].producer]) || (last[items[i].producer] < items[i].seq));
+            last[items[i].producer] = items[i].seq;
+            sum += items[i].seq;
+        }
+        if (n)
+            __atomic_add_fetch(&consumed, n, __ATOMIC_RELAXED);
+        else
+            sched_yield();
+    }
+    __atomic_add_fetch(&consumed_sum, sum, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+/* 返回耗时, 秒 */
+static double run(unsigned int producers, unsigned int consumers, unsigned int items, unsigned int batch)
+{
+    pthread_t tids[THREAD_MAX * 2];
+    struct timespec t0;
+    struct timespec t1;
+    unsigned int i;
+
+    producer_count = producers;
+    items_per_producer = items;
+    batch_size = batch;
+    consumed = 0;
+    consumed_sum = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < consumers; i++)
+        pthread_create(&tids[i], NULL, consumer_thread, (void *)(unsigned long)i);
+    for (i = 0; i < producers; i++)
+        pthread_create(&tids[consumers + i], NULL, producer_thread, (void *)(unsigned long)i);
+    for (i = 0; i < producers + consumers; i++)
+        pthread_join(tids[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    CHECK(producers * items == consumed);
+    CHECK((unsigned long long)producers * items * (items - 1) / 2 == consumed_sum);
+    return (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+}
+
+static void test_single(void)
+{
+    item_t in[TEST_COUNT + BATCH_MAX];
+    item_t out[TEST_COUNT + BATCH_MAX];
+    unsigned int rand_state = 1;
+    unsigned int put_seq = 0;
+    unsigned int get_seq = 0;
+    unsigned int count;
+    unsigned int n;
+    unsigned int i;
+    unsigned int k;
+
+    CHECK(0 == mpmc_init(&ring, TEST_COUNT, sizeof(item_t)));
+
+    /* 空队列取不到, 满队列只能放入剩余空间 */
+    CHECK(0 == mpmc_get(&ring, out, 1));
+    for (i = 0; i < TEST_COUNT + BATCH_MAX; i++)
+        in[i].seq = i;
+    CHECK(TEST_COUNT == mpmc_put(&ring, in, TEST_COUNT + BATCH_MAX));
+    CHECK(0 == mpmc_put(&ring, in, 1));
+    CHECK(TEST_COUNT == mpmc_get(&ring, out, TEST_COUNT + BATCH_MAX));
+    for (i = 0; i < TEST_COUNT; i++)
+        CHECK(i == out[i].seq);
+    CHECK(0 == mpmc_get(&ring, out, 1));
+
+    /* 随机大小的批量, 多次回绕, 检查顺序 */
+    put_seq = get_seq = 0;
+    for (k = 0; k < 100000; k++)
+    {
+        count = rand_r(&rand_state) % (2 * BATCH_MAX) + 1;
+        for (i = 0; i < count; i++)
+            in[i].seq = put_seq + i;
+        n = mpmc_put(&ring, in, count);
+        CHECK(n <= count);
+        CHECK((n == count) || (TEST_COUNT == put_seq + n - get_seq));
+        put_seq += n;
+
+        count = rand_r(&rand_state) % (2 * BATCH_MAX) + 1;
+        n = mpmc_get(&ring, out, count);
+        CHECK((n == count) || (put_seq == get_seq + n));
+        for (i = 0; i < n; i++)
+            CHECK(get_seq + i == out[i].seq);
+        get_seq += n;
+    }
+
+    mpmc_exit(&ring);
+}
+
+static void test_threads(void)
+{
+    static const unsigned int cfg[][2] = {{1, 1}, {1, 4}, {4, 1}, {4, 4}, {8, 8}};
+    unsigned int i;
+
+    for (i = 0; i < sizeof(cfg) / sizeof(cfg[0]); i++)
+    {
+        CHECK(0 == mpmc_init(&ring, TEST_COUNT, sizeof(item_t)));
+        run(cfg[i][0], cfg[i][1], ITEMS, 0);
+        run(cfg[i][0], cfg[i][1], ITEMS, 1);
+        mpmc_exit(&ring);
+    }
+}
+
+static void bench(void)
+{
+    static const unsigned int threads[] = {2, 4, 8, 16};
+    static const unsigned int batches[] = {1, 16};
+    unsigned int items;
+    unsigned int t;
+    unsigned int b;
+    double s;
+
+    printf("threads batch   mpmc   rbuf+mutex\n");
+    for (t = 0; t < sizeof(threads) / sizeof(threads[0]); t++)
+    {
+        for (b = 0; b < sizeof(batches) / sizeof(batches[0]); b++)
+        {
+            items = 1000000 / (threads[t] / 2);
+            printf("%7u %5u", threads[t], batches[b]);
+
+            use_rbuf = 0;
+            CHECK(0 == mpmc_init(&ring, TEST_COUNT, sizeof(item_t)));
+            s = run(threads[t] / 2, threads[t] / 2, items, batches[b]);
+            printf(" %6.1f", (threads[t] / 2) * items / s / 1e6);
+            mpmc_exit(&ring);
+
+            use_rbuf = 1;
+            CHECK(0 == rbuf_init(&rbuf, rbuf_mem, sizeof(rbuf_mem), sizeof(item_t)));
+            s = run(threads[t] / 2, threads[t] / 2, items, batches[b]);
+            printf(" %12.1f\n", (threads[t] / 2) * items / s / 1e6);
+        }
+    }
+    use_rbuf = 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if ((1 < argc) && (0 == strcmp(argv[1], "bench")))
+    {
+        bench();
+        return 0;
+    }
+
+    test_single();
+    test_threads();
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,190 @@
+/*
+ * record_ring 的正确性测试: 与简单的FIFO模型对比, 覆盖回绕, 填充标记, 批量取出和 commit 的参数检查
+ *
+ * gcc -O2 -Wall -I../src record_ring_test.c ../src/record_ring.c -o record_ring_test
+ * ./record_ring_test          通过时返回0
+ */
+#include "record_ring.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+
+#define RING_SIZE   256
+#define LEN_MAX     60
+#define MODEL_MAX   64     /* 模型中最多的记录数, 大于环中能放下的条数 */
+#define BATCH_MAX   4
+
+#define CHECK(cond) \
+    do{if (!(cond)){printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); exit(1);}}while(0)
+
+/* 模型: 按顺序保存未取出的记录, 第 i 条的内容为 (seq + j) */
+static unsigned int model_seq[MODEL_MAX];
+static unsigned int model_len[MODEL_MAX];
+static unsigned int model_put = 0;
+static unsigned int model_get = 0;
+static unsigned int next_seq = 0;
+
+
+
+
+static void fill(unsigned char *p, unsigned int seq, unsigned int len)
+{
+    unsigned int i;
+
+    for (i = 0; i < len; i++)
+        p[i] = (unsigned char)(seq + i);
+}
+
+static void check_record(const unsigned char *data, unsigned int len)
+{
+    unsigned int i;
+    unsigned int k = model_get % MODEL_MAX;
+
+    CHECK(model_get != model_put);
+    CHECK(model_len[k] == len);
+    for (i = 0; i < len; i++)
+        CHECK((unsigned char)(model_seq[k] + i) == data[i]);
+    model_get++;
+}
+
+static void model_add(unsigned int len)
+{
+    CHECK(MODEL_MAX > model_put - model_get);
+    model_seq[model_put % MODEL_MAX] = next_seq;
+    model_len[model_put % MODEL_MAX] = len;
+    model_put++;
+    next_seq += 7;
+}
+
+static void test_commit_args(void)
+{
+    static unsigned int mem[RING_SIZE / 4];
+    record_ring_t ring = RRING_INITIALIZER(mem, sizeof(mem));
+    record_ring_t ring2;
+    unsigned char *p;
+    unsigned char *data;
+
+    CHECK(0 == rring_init(&ring2, mem, sizeof(mem)));
+    CHECK(0 == memcmp(&ring, &ring2, sizeof(ring)));
+    CHECK(-1 == rring_init(&ring2, ((unsigned char *)mem) + 1, sizeof(mem) - 4));
+
+    /* 没有预留时不能提交 */
+    CHECK(-1 == rring_commit(&ring, 0));
+    CHECK(rring_empty(&ring));
+
+    /* 超过预留长度的提交被拒绝, 预留仍然有效 */
+    p = rring_reserve(&ring, 10);
+    CHECK(NULL != p);
+    CHECK(-1 == rring_commit(&ring, 11));
+    CHECK(rring_empty(&ring));
+    fill(p, 1, 8);
+    CHECK(0 == rring_commit(&ring, 8));
+    CHECK(!rring_empty(&ring));
+
+    /* 同一次预留只能提交一次 */
+    CHECK(-1 == rring_commit(&ring, 8));
+    CHECK(8 == rring_get(&ring, &data));
+    CHECK(1 == data[0]);
+    CHECK(0 == rring_get(&ring, &data));
+    CHECK(NULL == data);
+    CHECK(rring_empty(&ring));
+
+    /* 太长的记录 */
+    CHECK(NULL == rring_reserve(&ring, RING_SIZE - 3));
+    CHECK(0 == rring_can_reserve(&ring, RING_SIZE - 3));
+}
+
+static void test_random(void)
+{
+    static unsigned int mem[RING_SIZE / 4];
+    static unsigned int shadow[RING_SIZE / 4];
+    record_ring_t ring;
+    record_ring_t copy;
+    record_t records[BATCH_MAX];
+    unsigned int rand_state = 1;
+    unsigned int last_tail = 0;
+    unsigned int pads = 0;
+    unsigned int exact = 0;
+    unsigned int len;
+    unsigned int n;
+    unsigned int i;
+    unsigned int k;
+    unsigned char *p;
+    int can;
+
+    CHECK(0 == rring_init(&ring, mem, sizeof(mem)));
+    for (k = 0; k < 2000000; k++)
+    {
+        len = rand_r(&rand_state) % (LEN_MAX + 1);
+        switch (rand_r(&rand_state) % 6)
+        {
+        case 0:
+        case 1:
+            /* can_reserve 和 reserve 的结果一致, 并且不修改环 */
+            copy = ring;
+            memcpy(shadow, mem, sizeof(mem));
+            can = rring_can_reserve(&ring, len);
+            CHECK(0 == memcmp(&copy, &ring, sizeof(ring)));
+            CHECK(0 == memcmp(shadow, mem, sizeof(mem)));
+
+            last_tail = ring.tail;
+            p = rring_reserve(&ring, len);
+            CHECK(can == (NULL != p));
+            if (NULL == p)
+            {
+                /* 取完并释放后一定能放下 */
+                CHECK((model_put != model_get) || (ring.head != ring.cur));
+                break;
+            }
+            if ((0 == ring.reserved) && (0 != last_tail))
+                pads++;
+            n = len ? rand_r(&rand_state) % (len + 1) : 0;
+            fill(p, next_seq, n);
+            CHECK(-1 == rring_commit(&ring, len + 1));
+            CHECK(0 == rring_commit(&ring, n));
+            if (0 == ring.tail)
+                exact++;
+            model_add(n);
+            break;
+        case 2:
+            fill((unsigned char *)shadow, next_seq, len);
+            if (0 == rring_put(&ring, shadow, len))
+                model_add(len);
+            break;
+        case 3:
+            n = rring_get(&ring, &p);
+            if (NULL == p)
+            {
+                CHECK(model_put == model_get);
+                CHECK(rring_empty(&ring));
+                break;
+            }
+            check_record(p, n);
+            break;
+        case 4:
+            n = rring_get_batch(&ring, records, rand_r(&rand_state) % BATCH_MAX + 1);
+            for (i = 0; i < n; i++)
+                check_record(records[i].data, records[i].len);
+            break;
+        default:
+            rring_release(&ring);
+            break;
+        }
+        CHECK(rring_empty(&ring) == (model_put == model_get));
+    }
+
+    /* 回绕时写填充标记和正好用完尾部两种情况都要覆盖到 */
+    CHECK(0 < pads);
+    CHECK(0 < exact);
+}
+
+int main(void)
+{
+    test_commit_args();
+    test_random();
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,222 @@
+/*
+ * ring_buffer_pow2.h 的正确性测试(与简单的FIFO模型对比), 以及与 rbuf 的单次调用耗时对比
+ *
+ * gcc -O2 -Wall -I../src ring_buffer_pow2_test.c ../src/ring_buffer.c -o ring_buffer_pow2_test
+ * ./ring_buffer_pow2_test          正确性测试, 通过时返回0
+ * ./ring_buffer_pow2_test bench    1/4/16字节 put+get 的耗时, 单位 ns/次
+ */
+#include "ring_buffer_pow2.h"
+#include "ring_buffer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+
+
+#define TEST_COUNT  64
+#define BENCH_LOOPS 10000000
+
+#define CHECK(cond) \
+    do{if (!(cond)){printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); exit(1);}}while(0)
+
+typedef struct
+{
+    unsigned int id;
+    unsigned char data[8];
+}msg_t;
+
+RBUF_POW2_DEFINE(msg_ring, msg_t)
+
+/* 模型: 按顺序保存放入的字节 */
+static unsigned char model[1 << 20];
+static unsigned int model_put = 0;
+static unsigned int model_get = 0;
+static unsigned int model_held = 0;  /* 上一次 get 取出的数据在下一次 get 之前仍占用空间 */
+
+
+
+
+static void test_bytes(void)
+{
+    unsigned char mem[TEST_COUNT];
+    unsigned char in[TEST_COUNT * 2];
+    unsigned int rand_state = 1;
+    unsigned int used;
+    unsigned int count;
+    unsigned int n;
+    unsigned int i;
+    unsigned int k;
+    unsigned char *p;
+    rbuf8_t rb;
+    rbuf8_t rb2 = RBUF_POW2_INITIALIZER(mem, TEST_COUNT);
+
+    CHECK(0 == rbuf8_init(&rb, mem, TEST_COUNT));
+    CHECK(0 == memcmp(&rb, &rb2, sizeof(rb)));
+    CHECK(-1 == rbuf8_init(&rb, mem, TEST_COUNT - 1));
+    CHECK(-1 == rbuf8_init(&rb, mem, 1));
+    CHECK(0 == rbuf8_init(&rb, mem, TEST_COUNT));
+
+    /* 所有节点都可用 */
+    for (i = 0; i < TEST_COUNT; i++)
+        CHECK(1 == rbuf8_put1(&rb, i));
+    CHECK(0 == rbuf8_put1(&rb, 0));
+    CHECK(TEST_COUNT == rbuf8_count(&rb));
+    CHECK(TEST_COUNT == rbuf8_get(&rb, &p, TEST_COUNT * 2));
+    for (i = 0; i < TEST_COUNT; i++)
+        CHECK(i == p[i]);
+    CHECK(0 == rbuf8_get(&rb, &p, 1));
+
+    /* 随机操作, 多次回绕 */
+    for (k = 0; k < 1000000; k++)
+    {
+        used = model_put - model_get + model_held;
+        switch (rand_r(&rand_state) % 4)
+        {
+        case 0:
+        case 1:
+            count = rand_r(&rand_state) % (TEST_COUNT / 2) + 1;
+            for (i = 0; i < count; i++)
+                in[i] = rand_r(&rand_state);
+            n = rbuf8_put(&rb, in, count, k & 1);
+            if (TEST_COUNT - used >= count)
+                CHECK(n == count);
+            else
+                CHECK(n == ((k & 1) ? 0 : TEST_COUNT - used));
+            for (i = 0; i < n; i++)
+                model[(model_put + i) % sizeof(model)] = in[i];
+            model_put += n;
+            break;
+        case 2:
+            in[0] = rand_r(&rand_state);
+            n = rbuf8_put1(&rb, in[0]);
+            CHECK(n == ((TEST_COUNT > used) ? 1 : 0));
+            if (n)
+                model[model_put++ % sizeof(model)] = in[0];
+            break;
+        default:
+            count = rand_r(&rand_state) % (TEST_COUNT / 2) + 1;
+            n = rbuf8_get(&rb, &p, count);
+            CHECK(n <= count);
+            CHECK(n <= model_put - model_get);
+            /* 只在回绕处或取完时少于请求数量 */
+            CHECK((n == count) || (n == model_put - model_get) || (0 == ((model_get + n) & (TEST_COUNT - 1))));
+            for (i = 0; i < n; i++)
+                CHECK(p[i] == model[(model_get + i) % sizeof(model)]);
+            model_get += n;
+            model_held = n;
+            break;
+        }
+        CHECK(model_put - model_get == rbuf8_count(&rb));
+    }
+}
+
+static void test_struct(void)
+{
+    msg_t mem[8];
+    msg_t m;
+    msg_t *p;
+    msg_ring_t rb = RBUF_POW2_INITIALIZER(mem, 8);
+    unsigned int put_id = 0;
+    unsigned int get_id = 0;
+    unsigned int k;
+
+    for (k = 0; k < 1000; k++)
+    {
+        memset(&m, 0, sizeof(m));
+        m.id = put_id;
+        m.data[7] = put_id;
+        while (msg_ring_put1(&rb, m))
+        {
+            m.id = ++put_id;
+            m.data[7] = put_id;
+        }
+        CHECK(8 == put_id - get_id);
+        while (msg_ring_get(&rb, &p, 1))
+        {
+            CHECK(get_id == p->id);
+            CHECK((unsigned char)get_id == p->data[7]);
+            get_id++;
+        }
+        CHECK(put_id == get_id);
+    }
+}
+
+static double ns_since(const struct timespec *t0)
+{
+    struct timespec t1;
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return ((t1.tv_sec - t0->tv_sec) * 1e9 + (t1.tv_nsec - t0->tv_nsec)) / BENCH_LOOPS;
+}
+
+static void bench(void)
+{
+    static const unsigned int sizes[] = {1, 4, 16};
+    static unsigned char mem[1024];
+    unsigned char in[16] = {0};
+    unsigned char *p;
+    unsigned int sum = 0;
+    struct timespec t0;
+    ring_buffer_t ring;
+    rbuf8_t rb;
+    unsigned int s;
+    unsigned int i;
+
+    printf("bytes   rbuf  rbuf8  rbuf8_put1\n");
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        printf("%5u", sizes[s]);
+
+        rbuf_init(&ring, mem, sizeof(mem), 1);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (i = 0; i < BENCH_LOOPS; i++)
+        {
+            in[0] = i;
+            rbuf_put(&ring, in, sizes[s], 1);
+            sum += rbuf_get(&ring, &p, sizes[s]) + p[0];
+        }
+        printf(" %6.1f", ns_since(&t0));
+
+        rbuf8_init(&rb, mem, sizeof(mem));
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (i = 0; i < BENCH_LOOPS; i++)
+        {
+            in[0] = i;
+            rbuf8_put(&rb, in, sizes[s], 1);
+            sum += rbuf8_get(&rb, &p, sizes[s]) + p[0];
+        }
+        printf(" %6.1f", ns_since(&t0));
+
+        if (1 == sizes[s])
+        {
+            rbuf8_init(&rb, mem, sizeof(mem));
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            for (i = 0; i < BENCH_LOOPS; i++)
+            {
+                rbuf8_put1(&rb, i);
+                sum += rbuf8_get(&rb, &p, 1) + p[0];
+            }
+            printf(" %11.1f", ns_since(&t0));
+        }
+        printf("\n");
+    }
+    /* 防止循环被优化掉 */
+    if (1 == sum)
+        printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+    if ((1 < argc) && (0 == strcmp(argv[1], "bench")))
+    {
+        bench();
+        return 0;
+    }
+
+    test_bytes();
+    test_struct();
+    printf("ok\n");
+    return 0;
+}